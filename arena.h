@@ -0,0 +1,39 @@
+#pragma once
+
+#include <memory>
+#include <vector>
+
+// Allocates objects of one type in fixed size chunks. Pointers stay valid
+// until the object is freed, and freed objects are reused before the arena
+// grows.
+template <typename T, size_t kChunkSize = 4096>
+class arena {
+ public:
+  // Returns a value-initialized object.
+  T* allocate() {
+    if (!free_.empty()) {
+      T* p = free_.back();
+      free_.pop_back();
+      *p = T{};
+      return p;
+    }
+    if (used_ == kChunkSize) {
+      chunks_.push_back(std::make_unique<T[]>(kChunkSize));
+      used_ = 0;
+    }
+    return &chunks_.back()[used_++];
+  }
+
+  void free(T* p) { free_.push_back(p); }
+
+  void clear() {
+    chunks_.clear();
+    free_.clear();
+    used_ = kChunkSize;
+  }
+
+ private:
+  std::vector<std::unique_ptr<T[]>> chunks_;
+  std::vector<T*> free_;
+  size_t used_ = kChunkSize;  // in the last chunk
+};
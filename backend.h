@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "tracer.h"
+
+// Platform specific part of the tracer. A backend attaches to the target
+// process, captures raw stack frames of its threads and resolves addresses
+// into symbols. lookup(), lookup_line() and poll_modules() are called from
+// the symbolizer thread while sample() runs, everything else from the tracer
+// worker thread.
+class tracer::backend {
+ public:
+  virtual ~backend() = default;
+
+  // Throws std::exception when the process cannot be attached.
+  virtual void attach(uint32_t pid, const config& config) = 0;
+  virtual void detach() = 0;
+  virtual std::string process_name() = 0;
+
+  // Captures one round of samples. |threads| receives every live thread of
+  // the target and |samples| the stacks captured since the previous call,
+  // as deep as |budget| allows. Threads the budget has no room for are only
+  // listed in |threads|; backends start the next round after the last thread
+  // that was captured so every thread gets its turn.
+  virtual void sample(frame_budget* budget,
+                      std::vector<thread>* threads,
+                      std::vector<thread_sample>* samples) = 0;
+
+  // Called when the sample frequency changed while attached, for backends
+  // whose target is sampled by something other than the tracer's rounds.
+  virtual void configure(const config&) {}
+
+  // Called instead of sample() once a round while sampling is paused, for
+  // backends whose target waits on them between samples.
+  virtual void idle() {}
+
+  // Fills symbol and source line of |instruction_offset| into |symbol|.
+  virtual bool lookup(uint64_t instruction_offset, symbol* symbol) = 0;
+
+  // Fills only the source line, for addresses inside a function that an
+  // earlier lookup() already resolved.
+  virtual bool lookup_line(uint64_t instruction_offset, symbol* symbol) {
+    return lookup(instruction_offset, symbol);
+  }
+
+  // Appends the address ranges the target mapped since the previous call,
+  // with the generation lookup() stamps on symbols found in them. Backends
+  // that do not track mappings leave every generation at 0.
+  virtual void poll_modules(std::vector<mapped_range>*) {}
+};
+
+// Last stack of every thread. With config.skip_idle, backends reuse it for
+// threads whose cpu time did not advance since the previous round instead of
+// unwinding them again; such samples are marked idle.
+class idle_cache {
+ public:
+  // Returns the stack of |id| if the thread has not run since it was stored
+  // and it was captured at least |depth| deep.
+  const std::vector<tracer::stack_frame>* find(uint32_t id,
+                                               uint64_t cycles,
+                                               int depth) const {
+    auto it = entries_.find(id);
+    if (it == entries_.end() || it->second.cycles != cycles ||
+        it->second.depth < depth) {
+      return nullptr;
+    }
+    return &it->second.stack_frames;
+  }
+
+  void store(uint32_t id,
+             uint64_t cycles,
+             int depth,
+             const std::vector<tracer::stack_frame>& stack_frames) {
+    entries_[id] = entry{cycles, depth, stack_frames};
+  }
+
+  // Forgets the stack of |id|, for threads that did something their cpu
+  // time does not show yet.
+  void erase(uint32_t id) { entries_.erase(id); }
+
+  // Drops threads that have exited.
+  template <typename T>
+  void retain(const T& ids) {
+    std::erase_if(entries_,
+                  [&](const auto& entry) { return !ids.contains(entry.first); });
+  }
+
+ private:
+  struct entry {
+    uint64_t cycles;
+    int depth;
+    std::vector<tracer::stack_frame> stack_frames;
+  };
+  std::map<uint32_t, entry> entries_;
+};
+
+// Last stack of every thread. Consecutive samples of a thread usually share
+// their outer frames, so once an unwinder reaches a frame whose
+// (frame_offset, return_offset) is in the cached stack, the frames above it
+// are spliced in from the cache instead of being walked again.
+class suffix_cache {
+ public:
+  // Appends the cached callers of |frame| to |stack_frames|, up to
+  // |max_frames| in total. Returns false when |frame| is not cached.
+  bool splice(uint32_t id,
+              const tracer::stack_frame& frame,
+              int max_frames,
+              std::vector<tracer::stack_frame>* stack_frames) const {
+    auto it = entries_.find(id);
+    if (it == entries_.end()) {
+      return false;
+    }
+
+    // frame offsets grow towards the outermost frame
+    const auto& cached = it->second;
+    auto match = std::lower_bound(
+        cached.begin(), cached.end(), frame.frame_offset,
+        [](const tracer::stack_frame& sf, uint64_t frame_offset) {
+          return sf.frame_offset < frame_offset;
+        });
+    if (match == cached.end() || match->frame_offset != frame.frame_offset ||
+        match->return_offset != frame.return_offset) {
+      return false;
+    }
+
+    for (auto sf = match + 1;
+         sf != cached.end() && (int)stack_frames->size() < max_frames; ++sf) {
+      stack_frames->push_back(*sf);
+      stack_frames->back().frame_number = (uint32_t)stack_frames->size() - 1;
+    }
+    return true;
+  }
+
+  void store(uint32_t id, const std::vector<tracer::stack_frame>& stack_frames) {
+    entries_[id] = stack_frames;
+  }
+
+  // Drops threads that have exited.
+  template <typename T>
+  void retain(const T& ids) {
+    std::erase_if(entries_,
+                  [&](const auto& entry) { return !ids.contains(entry.first); });
+  }
+
+ private:
+  std::map<uint32_t, std::vector<tracer::stack_frame>> entries_;
+};
+
+#if defined(_WIN32)
+std::unique_ptr<tracer::backend> create_dbgeng_backend();
+#elif defined(__linux__)
+std::unique_ptr<tracer::backend> create_perf_backend();
+std::unique_ptr<tracer::backend> create_ptrace_backend();
+#endif
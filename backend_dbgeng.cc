@@ -0,0 +1,338 @@
+#if defined(_WIN32)
+
+#include "backend.h"
+
+#include <wil/result.h>
+#include <wil/resource.h>
+#include <winrt/base.h>
+#include <dbgeng.h>
+#include <dbghelp.h>
+#include <wrl.h>
+using namespace Microsoft::WRL;
+
+#include <set>
+#include <vector>
+
+#pragma comment(lib, "dbgeng.lib")
+
+namespace {
+
+std::string narrow(const std::wstring& str) {
+  return winrt::to_string(str);
+}
+
+uint64_t timestamp() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// frames walked before looking for a frame of the previous sample
+constexpr int kSpliceProbeFrames = 16;
+
+class dbgeng_backend : public tracer::backend {
+ public:
+  ~dbgeng_backend() override { detach(); }
+
+  void attach(uint32_t pid, const tracer::config& config) override;
+  void detach() override;
+  std::string process_name() override { return process_name_; }
+  void sample(tracer::frame_budget* budget,
+              std::vector<tracer::thread>* threads,
+              std::vector<tracer::thread_sample>* samples) override;
+  bool lookup(uint64_t instruction_offset,
+              tracer::symbol* symbol) override;
+  bool lookup_line(uint64_t instruction_offset,
+                   tracer::symbol* symbol) override;
+
+ private:
+  std::vector<tracer::stack_frame> capture_stack_frames(uint32_t thread_id,
+                                                        int fill_frames);
+  std::vector<tracer::stack_frame> walk_stack_frames(int fill_frames);
+  IDebugSymbols5* lookup_symbols();
+
+  std::string process_name_;
+  ULONG first_thread_ = 0;
+  bool skip_idle_ = false;
+  bool splice_stacks_ = false;
+  idle_cache idle_cache_;
+  suffix_cache suffix_cache_;
+
+  ComPtr<IDebugClient8> debug_client_;
+  ComPtr<IDebugControl7> debug_control_;
+  ComPtr<IDebugSystemObjects4> debug_system_objects_;
+  ComPtr<IDebugSymbols5> debug_symbols_;
+  // DbgEng interfaces belong to the thread that created them, lookups run
+  // on the symbolizer thread through a client of their own
+  ComPtr<IDebugClient8> lookup_client_;
+  ComPtr<IDebugSymbols5> lookup_symbols_;
+};
+
+void dbgeng_backend::attach(uint32_t pid,
+                            const tracer::config& config) {
+  wil::unique_process_handle handle(
+      ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid));
+  if (!handle) {
+    throw std::domain_error("failed to OpenProcess().");
+  }
+  wchar_t name[4096];
+  DWORD size = sizeof(name);
+  BOOL ret = ::QueryFullProcessImageName(handle.get(), 0, name, &size);
+  if (!ret) {
+    throw std::domain_error("failed to QueryFullProcessImageName().");
+  }
+  process_name_ = narrow(name);
+  skip_idle_ = config.skip_idle;
+  splice_stacks_ = config.splice_stacks;
+
+  HRESULT hr = ::DebugCreate(__uuidof(IDebugClient8), &debug_client_);
+  THROW_IF_FAILED(hr);
+
+  hr = debug_client_.As(&debug_control_);
+  THROW_IF_FAILED(hr);
+
+  hr = debug_client_.As(&debug_system_objects_);
+  THROW_IF_FAILED(hr);
+
+  hr = debug_client_.As(&debug_symbols_);
+  THROW_IF_FAILED(hr);
+
+  hr = debug_client_->AttachProcess(
+      0ull, pid,
+      DEBUG_ATTACH_NONINVASIVE | DEBUG_ATTACH_NONINVASIVE_NO_SUSPEND);
+  THROW_IF_FAILED(hr);
+
+  hr = debug_control_->WaitForEvent(DEBUG_WAIT_DEFAULT, INFINITE);
+  THROW_IF_FAILED(hr);
+}
+
+void dbgeng_backend::detach() {
+  if (debug_client_) {
+    debug_client_->DetachProcesses();
+  }
+  lookup_symbols_.Reset();
+  lookup_client_.Reset();
+  debug_symbols_.Reset();
+  debug_system_objects_.Reset();
+  debug_control_.Reset();
+  debug_client_.Reset();
+}
+
+void dbgeng_backend::sample(tracer::frame_budget* budget,
+                            std::vector<tracer::thread>* threads,
+                            std::vector<tracer::thread_sample>* samples) {
+  ULONG total_thread_count = 0, largest_process = 0;
+  HRESULT hr = debug_system_objects_->GetTotalNumberThreads(
+      &total_thread_count, &largest_process);
+  if (FAILED(hr)) {
+    return;
+  }
+
+  ULONG first_thread = first_thread_;
+  bool exhausted = false;
+  std::set<uint32_t> live;
+  for (ULONG n = 0; n < total_thread_count; ++n) {
+    ULONG i = (first_thread + n) % total_thread_count;
+    hr = debug_system_objects_->SetCurrentThreadId(i);
+    if (FAILED(hr)) {
+      continue;
+    }
+
+    // set thread
+    ULONG thread_system_id = 0;
+    hr = debug_system_objects_->GetCurrentThreadSystemId(&thread_system_id);
+    if (FAILED(hr)) {
+      continue;
+    }
+
+    // get cycles
+    wil::unique_handle handle(
+        ::OpenThread(THREAD_QUERY_INFORMATION, FALSE, thread_system_id));
+    unsigned long long cycles = 0;
+    ::QueryThreadCycleTime(handle.get(), &cycles);
+
+    // capture stackframe
+    int depth = budget->depth(thread_system_id);
+    if (depth == 0 && !exhausted) {
+      exhausted = true;
+      first_thread_ = i;
+    }
+    live.insert(thread_system_id);
+
+    // a thread that has not run still has the same stack
+    const std::vector<tracer::stack_frame>* cached = nullptr;
+    if (skip_idle_) {
+      cached = idle_cache_.find(thread_system_id, cycles, std::max(depth, 1));
+    }
+    std::vector<tracer::stack_frame> sf;
+    if (cached) {
+      sf = *cached;
+    } else {
+      sf = capture_stack_frames(thread_system_id, std::max(depth, 1));
+      if (sf.empty()) {
+        continue;
+      }
+      if (splice_stacks_ && depth > 1) {
+        suffix_cache_.store(thread_system_id, sf);
+      }
+      if (skip_idle_) {
+        idle_cache_.store(thread_system_id, cycles, std::max(depth, 1), sf);
+      }
+    }
+
+    threads->push_back(tracer::thread{
+        .id = thread_system_id,
+        .cycles = cycles,
+        .instruction_offset = sf[0].instruction_offset,
+        .idle = cached != nullptr,
+    });
+    if (depth == 0) {
+      continue;
+    }
+    if (!cached) {
+      budget->consume(thread_system_id, sf.size());
+    }
+    samples->push_back(tracer::thread_sample{
+        .id = thread_system_id,
+        .timestamp = timestamp(),
+        .idle = cached != nullptr,
+        .stack_frames = std::move(sf),
+    });
+  }
+  idle_cache_.retain(live);
+  suffix_cache_.retain(live);
+}
+
+bool dbgeng_backend::lookup(uint64_t instruction_offset,
+                            tracer::symbol* symbol) {
+  uint8_t buffer[1024];
+  ULONG needed = 0;
+  ULONG64 displacement = 0;
+  IDebugSymbols5* debug_symbols = lookup_symbols();
+  if (!debug_symbols) {
+    return false;
+  }
+  HRESULT hr;
+  hr = debug_symbols->GetFunctionEntryByOffset(
+      instruction_offset, 0, buffer, sizeof(buffer), &needed);
+  if (SUCCEEDED(hr)) {
+    wchar_t name[1024 * 2]{};
+    ULONG name_size = 0;
+    hr = debug_symbols->GetNameByOffsetWide(instruction_offset, name,
+                                            sizeof(name), &name_size,
+                                            &displacement);
+    if (SUCCEEDED(hr)) {
+      if (needed == sizeof(FPO_DATA)) {
+        const FPO_DATA* fpo_data = (FPO_DATA*)(buffer);
+        symbol->address = fpo_data->ulOffStart;
+        // todo:
+      } else if (needed == sizeof(IMAGE_FUNCTION_ENTRY)) {
+        const IMAGE_FUNCTION_ENTRY* image_function_entry = (IMAGE_FUNCTION_ENTRY*)(buffer);
+        symbol->function_name = narrow(name);
+        symbol->address = image_function_entry->StartingAddress;
+        symbol->size = image_function_entry->EndingAddress -
+                       image_function_entry->StartingAddress;
+      }
+      symbol->displacement = displacement;
+    }
+  } else {
+    return false;
+  }
+
+  lookup_line(instruction_offset, symbol);
+  return true;
+}
+
+bool dbgeng_backend::lookup_line(uint64_t instruction_offset,
+                                 tracer::symbol* symbol) {
+  IDebugSymbols5* debug_symbols = lookup_symbols();
+  if (!debug_symbols) {
+    return false;
+  }
+  ULONG line = 0;
+  ULONG64 displacement = 0;
+  wchar_t file_name[1024 * 2];
+  ULONG file_name_size = 0;
+  HRESULT hr = debug_symbols->GetLineByOffsetWide(
+      instruction_offset, &line, file_name, sizeof(file_name),
+      &file_name_size, &displacement);
+  if (FAILED(hr)) {
+    return false;
+  }
+  symbol->source_name = narrow(file_name);
+  symbol->source_line = line;
+  return true;
+}
+
+// Created on first use by the thread doing lookups.
+IDebugSymbols5* dbgeng_backend::lookup_symbols() {
+  if (!lookup_symbols_) {
+    ComPtr<IDebugClient8> client;
+    HRESULT hr = debug_client_->CreateClient(
+        reinterpret_cast<PDEBUG_CLIENT*>(client.GetAddressOf()));
+    if (FAILED(hr) || FAILED(client.As(&lookup_symbols_))) {
+      return nullptr;
+    }
+    lookup_client_ = std::move(client);
+  }
+  return lookup_symbols_.Get();
+}
+
+std::vector<tracer::stack_frame> dbgeng_backend::capture_stack_frames(
+    uint32_t thread_id,
+    int fill_frames) {
+  if (!splice_stacks_ || fill_frames <= kSpliceProbeFrames) {
+    return walk_stack_frames(fill_frames);
+  }
+
+  // GetStackTraceEx() cannot stop early, so walk a few frames first and only
+  // walk the whole stack when none of them is in the previous sample
+  std::vector<tracer::stack_frame> probe =
+      walk_stack_frames(kSpliceProbeFrames);
+  std::vector<tracer::stack_frame> sfs;
+  for (const auto& sf : probe) {
+    sfs.push_back(sf);
+    if (suffix_cache_.splice(thread_id, sf, fill_frames, &sfs)) {
+      return sfs;
+    }
+  }
+  if ((int)probe.size() < kSpliceProbeFrames) {
+    return probe;
+  }
+  return walk_stack_frames(fill_frames);
+}
+
+std::vector<tracer::stack_frame> dbgeng_backend::walk_stack_frames(
+    int fill_frames) {
+  ULONG filled_frames{};
+  std::vector<DEBUG_STACK_FRAME_EX> frames(fill_frames);
+
+  HRESULT hr = debug_control_->GetStackTraceEx(
+      NULL, NULL, NULL, &frames.front(), (int)frames.size(), &filled_frames);
+  if (FAILED(hr)) {
+    return {};
+  }
+
+  std::vector<tracer::stack_frame> sfs;
+  for (int i = 0; i < (int)filled_frames; ++i) {
+    tracer::stack_frame sf{};
+    sf.instruction_offset = frames[i].InstructionOffset;
+    sf.frame_offset = frames[i].FrameOffset;
+    sf.frame_number = frames[i].FrameNumber;
+    sf.return_offset = frames[i].ReturnOffset;
+    sf.stack_offset = frames[i].StackOffset;
+    sf.func_table_entry = frames[i].FuncTableEntry;
+    sf.is_virtual = frames[i].Virtual;
+    sfs.emplace_back(sf);
+  }
+
+  return sfs;
+}
+
+}  // namespace
+
+std::unique_ptr<tracer::backend> create_dbgeng_backend() {
+  return std::make_unique<dbgeng_backend>();
+}
+
+#endif  // defined(_WIN32)
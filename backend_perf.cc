@@ -0,0 +1,335 @@
+#if defined(__linux__)
+
+#include "backend.h"
+#include "elf_symbolizer.h"
+
+#include <dirent.h>
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr int kRingPages = 16;  // data pages, power of two
+constexpr auto kRescanInterval = std::chrono::milliseconds(100);
+
+// perf_event_open() refuses frequencies above this, and the kernel lowers it
+// by itself when sampling interrupts take too long.
+uint64_t sample_frequency(double frequency) {
+  uint64_t max_rate = 0;
+  std::ifstream ifs("/proc/sys/kernel/perf_event_max_sample_rate");
+  if (!(ifs >> max_rate) || max_rate == 0) {
+    max_rate = UINT64_MAX;
+  }
+  return std::clamp<uint64_t>((uint64_t)std::max(frequency, 1.0), 1,
+                              max_rate);
+}
+
+std::set<uint32_t> list_threads(uint32_t pid) {
+  std::set<uint32_t> tids;
+  std::string path = "/proc/" + std::to_string(pid) + "/task";
+  DIR* dir = ::opendir(path.c_str());
+  if (!dir) {
+    return tids;
+  }
+  while (dirent* entry = ::readdir(dir)) {
+    if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9') {
+      tids.insert((uint32_t)std::stoul(entry->d_name));
+    }
+  }
+  ::closedir(dir);
+  return tids;
+}
+
+// Samples every thread of the target with a task-clock software event.
+// The kernel unwinds user callchains on each timer interrupt and writes them
+// into a per-thread ring buffer, so the target is never stopped.
+class perf_backend : public tracer::backend {
+ public:
+  ~perf_backend() override { detach(); }
+
+  void attach(uint32_t pid, const tracer::config& config) override;
+  void detach() override;
+  void configure(const tracer::config& config) override;
+  std::string process_name() override { return process_name_; }
+  void sample(tracer::frame_budget* budget,
+              std::vector<tracer::thread>* threads,
+              std::vector<tracer::thread_sample>* samples) override;
+  bool lookup(uint64_t instruction_offset,
+              tracer::symbol* symbol) override;
+  bool lookup_line(uint64_t instruction_offset,
+                   tracer::symbol* symbol) override;
+  void poll_modules(std::vector<tracer::mapped_range>* ranges) override;
+
+ private:
+  struct event {
+    int fd = -1;
+    void* ring = nullptr;
+    uint64_t cycles = 0;  // task-clock, ns
+    uint64_t instruction_offset = 0;
+  };
+
+  bool open_event(uint32_t tid, event* ev);
+  void close_event(event* ev);
+  void rescan();
+  void drain(event* ev,
+             tracer::frame_budget* budget,
+             std::vector<tracer::thread_sample>* samples);
+
+  uint32_t pid_ = 0;
+  uint64_t frequency_ = 0;
+  std::string process_name_;
+  size_t page_size_ = 0;
+  std::map<uint32_t, event> events_;
+  std::chrono::steady_clock::time_point last_rescan_;
+  elf_symbolizer symbolizer_;
+  std::vector<uint8_t> record_;
+};
+
+void perf_backend::attach(uint32_t pid,
+                          const tracer::config& config) {
+  pid_ = pid;
+  frequency_ = sample_frequency(config.sample_frequency);
+  page_size_ = (size_t)::sysconf(_SC_PAGESIZE);
+
+  std::error_code ec;
+  auto exe = std::filesystem::read_symlink(
+      "/proc/" + std::to_string(pid) + "/exe", ec);
+  if (ec) {
+    throw std::domain_error("failed to read /proc/<pid>/exe.");
+  }
+  process_name_ = exe.string();
+  symbolizer_.attach(pid);
+
+  for (uint32_t tid : list_threads(pid)) {
+    event ev;
+    if (!open_event(tid, &ev)) {
+      int err = errno;
+      detach();
+      throw std::domain_error(std::string("failed to perf_event_open(): ") +
+                              std::strerror(err));
+    }
+    events_.emplace(tid, ev);
+  }
+  if (events_.empty()) {
+    throw std::domain_error("failed to list /proc/<pid>/task.");
+  }
+  last_rescan_ = std::chrono::steady_clock::now();
+}
+
+void perf_backend::detach() {
+  symbolizer_.detach();
+  for (auto& [tid, ev] : events_) {
+    close_event(&ev);
+  }
+  events_.clear();
+}
+
+// Events in frequency mode take the new frequency as their period.
+void perf_backend::configure(const tracer::config& config) {
+  uint64_t frequency = sample_frequency(config.sample_frequency);
+  if (frequency == frequency_) {
+    return;
+  }
+  frequency_ = frequency;
+  for (auto& [tid, ev] : events_) {
+    ::ioctl(ev.fd, PERF_EVENT_IOC_PERIOD, &frequency_);
+  }
+}
+
+bool perf_backend::open_event(uint32_t tid, event* ev) {
+  perf_event_attr attr{};
+  attr.size = sizeof(attr);
+  attr.type = PERF_TYPE_SOFTWARE;
+  attr.config = PERF_COUNT_SW_TASK_CLOCK;
+  attr.freq = 1;
+  attr.sample_freq = frequency_;
+  attr.sample_type =
+      PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN;
+  attr.use_clockid = 1;
+  attr.clockid = CLOCK_MONOTONIC;  // same as steady_clock
+  attr.exclude_kernel = 1;
+  attr.exclude_hv = 1;
+  attr.exclude_callchain_kernel = 1;
+  attr.disabled = 1;
+
+  int fd = (int)::syscall(SYS_perf_event_open, &attr, (pid_t)tid, -1, -1,
+                          PERF_FLAG_FD_CLOEXEC);
+  if (fd < 0) {
+    return false;
+  }
+  void* ring = ::mmap(nullptr, (kRingPages + 1) * page_size_,
+                      PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  if (ring == MAP_FAILED) {
+    ::close(fd);
+    return false;
+  }
+  ::ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+  ev->fd = fd;
+  ev->ring = ring;
+  return true;
+}
+
+void perf_backend::close_event(event* ev) {
+  if (ev->ring) {
+    ::munmap(ev->ring, (kRingPages + 1) * page_size_);
+    ev->ring = nullptr;
+  }
+  if (ev->fd >= 0) {
+    ::close(ev->fd);
+    ev->fd = -1;
+  }
+}
+
+// Follows threads created and exited since the last scan.
+void perf_backend::rescan() {
+  std::set<uint32_t> tids = list_threads(pid_);
+  for (auto it = events_.begin(); it != events_.end();) {
+    if (!tids.contains(it->first)) {
+      close_event(&it->second);
+      it = events_.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  for (uint32_t tid : tids) {
+    if (!events_.contains(tid)) {
+      event ev;
+      if (open_event(tid, &ev)) {
+        events_.emplace(tid, ev);
+      }
+    }
+  }
+
+  // refresh cpu time
+  for (auto& [tid, ev] : events_) {
+    uint64_t value = 0;
+    if (::read(ev.fd, &value, sizeof(value)) == sizeof(value)) {
+      ev.cycles = value;
+    }
+  }
+}
+
+void perf_backend::drain(event* ev,
+                         tracer::frame_budget* budget,
+                         std::vector<tracer::thread_sample>* samples) {
+  auto* meta = (perf_event_mmap_page*)ev->ring;
+  const uint8_t* data = (const uint8_t*)ev->ring + page_size_;
+  const uint64_t size = kRingPages * page_size_;
+
+  uint64_t head = __atomic_load_n(&meta->data_head, __ATOMIC_ACQUIRE);
+  uint64_t tail = meta->data_tail;
+  while (tail < head) {
+    // records are 8 byte aligned, so the header never wraps
+    const auto* header = (const perf_event_header*)(data + tail % size);
+    if (header->size < sizeof(*header) || tail + header->size > head) {
+      break;
+    }
+
+    if (header->type == PERF_RECORD_SAMPLE) {
+      // records may wrap around the end of the ring
+      const uint8_t* record = data + tail % size;
+      if (tail % size + header->size > size) {
+        record_.resize(header->size);
+        for (size_t i = 0; i < header->size; ++i) {
+          record_[i] = data[(tail + i) % size];
+        }
+        record = record_.data();
+      }
+
+      // PERF_SAMPLE_TID | PERF_SAMPLE_TIME | PERF_SAMPLE_CALLCHAIN
+      const uint8_t* p = record + sizeof(*header);
+      uint32_t sample_tid = ((const uint32_t*)p)[1];
+      uint64_t time = *(const uint64_t*)(p + 8);
+      uint64_t nr = *(const uint64_t*)(p + 16);
+      const uint64_t* ips = (const uint64_t*)(p + 24);
+      nr = std::min<uint64_t>(nr, (header->size - sizeof(*header) - 24) / 8);
+
+      // the kernel unwound the stack already, so the budget does not apply;
+      // of threads not captured only the pc is kept for the thread list
+      bool captured = budget->captured(sample_tid);
+      int depth = captured ? budget->max_frames : 1;
+      tracer::thread_sample sample{.id = sample_tid,
+                                   .timestamp = time,
+                                   .idle = false,
+                                   .stack_frames = {}};
+      for (uint64_t i = 0; i < nr && (int)sample.stack_frames.size() < depth;
+           ++i) {
+        if (ips[i] >= PERF_CONTEXT_MAX) {
+          continue;  // context marker
+        }
+        tracer::stack_frame sf{};
+        sf.instruction_offset = ips[i];
+        sf.frame_number = (uint32_t)sample.stack_frames.size();
+        if (!sample.stack_frames.empty()) {
+          sample.stack_frames.back().return_offset = ips[i];
+        }
+        sample.stack_frames.push_back(sf);
+      }
+      if (!sample.stack_frames.empty()) {
+        ev->instruction_offset = sample.stack_frames[0].instruction_offset;
+        if (captured) {
+          samples->push_back(std::move(sample));
+        }
+      }
+    }
+    tail += header->size;
+  }
+  __atomic_store_n(&meta->data_tail, tail, __ATOMIC_RELEASE);
+}
+
+void perf_backend::sample(tracer::frame_budget* budget,
+                          std::vector<tracer::thread>* threads,
+                          std::vector<tracer::thread_sample>* samples) {
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_rescan_ >= kRescanInterval) {
+    rescan();
+    last_rescan_ = now;
+  }
+
+  for (auto& [tid, ev] : events_) {
+    drain(&ev, budget, samples);
+    if (ev.instruction_offset) {
+      threads->push_back(tracer::thread{
+          .id = tid,
+          .cycles = ev.cycles,
+          .instruction_offset = ev.instruction_offset,
+          .idle = false,
+      });
+    }
+  }
+}
+
+bool perf_backend::lookup(uint64_t instruction_offset,
+                          tracer::symbol* symbol) {
+  return symbolizer_.lookup(instruction_offset, symbol);
+}
+
+bool perf_backend::lookup_line(uint64_t instruction_offset,
+                               tracer::symbol* symbol) {
+  return symbolizer_.lookup_line(instruction_offset, symbol);
+}
+
+void perf_backend::poll_modules(std::vector<tracer::mapped_range>* ranges) {
+  symbolizer_.poll(ranges);
+}
+
+}  // namespace
+
+std::unique_ptr<tracer::backend> create_perf_backend() {
+  return std::make_unique<perf_backend>();
+}
+
+#endif  // defined(__linux__)
@@ -0,0 +1,514 @@
+#if defined(__linux__)
+
+#include "backend.h"
+#include "elf_symbolizer.h"
+#include "worker_pool.h"
+
+#include <dirent.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/ptrace.h>
+#include <sys/uio.h>
+#include <sys/user.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <iterator>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr size_t kStackCopySize = 32 * 1024;
+constexpr auto kRescanInterval = std::chrono::milliseconds(100);
+
+std::set<uint32_t> list_threads(uint32_t pid) {
+  std::set<uint32_t> tids;
+  std::string path = "/proc/" + std::to_string(pid) + "/task";
+  DIR* dir = ::opendir(path.c_str());
+  if (!dir) {
+    return tids;
+  }
+  while (dirent* entry = ::readdir(dir)) {
+    if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9') {
+      tids.insert((uint32_t)std::stoul(entry->d_name));
+    }
+  }
+  ::closedir(dir);
+  return tids;
+}
+
+uint64_t timestamp() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// on-cpu time in ns, first field of /proc/<pid>/task/<tid>/schedstat
+uint64_t read_schedstat(int fd) {
+  char buffer[128];
+  ssize_t size = ::pread(fd, buffer, sizeof(buffer) - 1, 0);
+  if (size <= 0) {
+    return 0;
+  }
+  buffer[size] = '\0';
+  return std::strtoull(buffer, nullptr, 10);
+}
+
+struct registers {
+  uint64_t pc;
+  uint64_t sp;
+  uint64_t fp;
+};
+
+bool get_registers(uint32_t tid, registers* regs) {
+#if defined(__x86_64__)
+  user_regs_struct raw{};
+#elif defined(__aarch64__)
+  user_pt_regs raw{};
+#endif
+  iovec iov{.iov_base = &raw, .iov_len = sizeof(raw)};
+  if (::ptrace(PTRACE_GETREGSET, tid, NT_PRSTATUS, &iov) != 0) {
+    return false;
+  }
+#if defined(__x86_64__)
+  *regs = {.pc = raw.rip, .sp = raw.rsp, .fp = raw.rbp};
+#elif defined(__aarch64__)
+  *regs = {.pc = raw.pc, .sp = raw.sp, .fp = raw.regs[29]};
+#endif
+  return true;
+}
+
+// Lets a stopped tracee run again. Signals are delivered and group-stops are
+// kept stopped.
+void resume(uint32_t tid, int status) {
+  int sig = WSTOPSIG(status);
+  if (status >> 16 == PTRACE_EVENT_STOP) {
+    if (sig == SIGSTOP || sig == SIGTSTP || sig == SIGTTIN || sig == SIGTTOU) {
+      ::ptrace(PTRACE_LISTEN, tid, nullptr, nullptr);
+    } else {
+      ::ptrace(PTRACE_CONT, tid, nullptr, nullptr);
+    }
+  } else {
+    ::ptrace(PTRACE_CONT, tid, nullptr, (void*)(intptr_t)sig);
+  }
+}
+
+// Stops each thread only for as long as it takes to read its registers and
+// copy the top of its stack, then unwinds the frame pointer chain on the
+// local copy after the thread has been resumed. Used where
+// perf_event_paranoid does not allow perf_event_open(). Threads are split
+// across config.unwind_workers workers that capture them in parallel.
+class ptrace_backend : public tracer::backend {
+ public:
+  ~ptrace_backend() override { detach(); }
+
+  void attach(uint32_t pid, const tracer::config& config) override;
+  void detach() override;
+  std::string process_name() override { return process_name_; }
+  void sample(tracer::frame_budget* budget,
+              std::vector<tracer::thread>* threads,
+              std::vector<tracer::thread_sample>* samples) override;
+  void idle() override;
+  bool lookup(uint64_t instruction_offset,
+              tracer::symbol* symbol) override;
+  bool lookup_line(uint64_t instruction_offset,
+                   tracer::symbol* symbol) override;
+  void poll_modules(std::vector<tracer::mapped_range>* ranges) override;
+
+ private:
+  struct thread_state {
+    uint64_t cycles = 0;  // ns
+    int schedstat = -1;
+  };
+
+  // Threads traced by one worker. ptrace requests are only accepted from the
+  // thread that seized the tracee, so every worker owns a disjoint set of
+  // threads and captures them concurrently with the others.
+  struct partition {
+    std::map<uint32_t, thread_state> threads;
+    uint32_t first_thread = 0;
+    std::vector<uint8_t> stack;
+    std::vector<tracer::thread> captured;
+    std::vector<tracer::thread_sample> samples;
+    idle_cache idle_stacks;
+    suffix_cache suffixes;
+    int error = 0;
+  };
+
+  bool seize(partition* part, uint32_t tid);
+  void release(thread_state* state);
+  void drain(partition* part);
+  bool interrupt(partition* part,
+                 uint32_t tid,
+                 registers* regs,
+                 size_t* copied,
+                 uint64_t* timestamp);
+  void rescan();
+  void capture(partition* part, tracer::frame_budget* budget);
+  std::vector<tracer::stack_frame> unwind(const partition& part,
+                                          uint32_t tid,
+                                          const registers& regs,
+                                          size_t copied,
+                                          int max_frames);
+  int owner(uint32_t tid) const { return (int)(tid % partitions_.size()); }
+
+  uint32_t pid_ = 0;
+  std::string process_name_;
+  bool skip_idle_ = false;
+  bool splice_stacks_ = false;
+  std::unique_ptr<worker_pool> pool_;
+  std::vector<partition> partitions_;
+  std::chrono::steady_clock::time_point last_rescan_;
+  elf_symbolizer symbolizer_;
+};
+
+void ptrace_backend::attach(uint32_t pid,
+                            const tracer::config& config) {
+  pid_ = pid;
+
+  std::error_code ec;
+  auto exe = std::filesystem::read_symlink(
+      "/proc/" + std::to_string(pid) + "/exe", ec);
+  if (ec) {
+    throw std::domain_error("failed to read /proc/<pid>/exe.");
+  }
+  process_name_ = exe.string();
+  symbolizer_.attach(pid);
+  skip_idle_ = config.skip_idle;
+  splice_stacks_ = config.splice_stacks;
+
+  pool_ = std::make_unique<worker_pool>(config.unwind_workers);
+  partitions_.resize(pool_->size());
+  for (auto& part : partitions_) {
+    part.stack.resize(kStackCopySize);
+  }
+
+  std::set<uint32_t> tids = list_threads(pid);
+  if (tids.empty()) {
+    throw std::domain_error("failed to list /proc/<pid>/task.");
+  }
+  pool_->run([&](int worker) {
+    auto& part = partitions_[worker];
+    for (uint32_t tid : tids) {
+      if (owner(tid) == worker && !seize(&part, tid)) {
+        part.error = errno;
+        break;
+      }
+    }
+  });
+  for (const auto& part : partitions_) {
+    if (part.error) {
+      detach();
+      throw std::domain_error(std::string("failed to PTRACE_SEIZE: ") +
+                              std::strerror(part.error));
+    }
+  }
+  rescan();
+  last_rescan_ = std::chrono::steady_clock::now();
+}
+
+void ptrace_backend::detach() {
+  symbolizer_.detach();
+  if (!pool_) {
+    return;
+  }
+
+  // a tracee has to be stopped to be detached
+  pool_->run([&](int worker) {
+    for (auto& [tid, state] : partitions_[worker].threads) {
+      release(&state);
+      if (::ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) != 0) {
+        continue;
+      }
+      int status = 0;
+      if (::waitpid(tid, &status, __WALL) == (pid_t)tid &&
+          WIFSTOPPED(status)) {
+        int sig = status >> 16 == 0 ? WSTOPSIG(status) : 0;
+        ::ptrace(PTRACE_DETACH, tid, nullptr, (void*)(intptr_t)sig);
+      }
+    }
+  });
+  partitions_.clear();
+  pool_.reset();
+}
+
+bool ptrace_backend::seize(partition* part, uint32_t tid) {
+  if (::ptrace(PTRACE_SEIZE, tid, nullptr, nullptr) != 0) {
+    return false;
+  }
+  std::string path = "/proc/" + std::to_string(pid_) + "/task/" +
+                     std::to_string(tid) + "/schedstat";
+  int schedstat = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  part->threads.emplace(tid, thread_state{.schedstat = schedstat});
+  return true;
+}
+
+void ptrace_backend::release(thread_state* state) {
+  if (state->schedstat >= 0) {
+    ::close(state->schedstat);
+    state->schedstat = -1;
+  }
+}
+
+// Collects what the tracees of |part| reported since the previous call
+// without blocking: signals are delivered right away instead of at the next
+// interrupt, and threads that exited are reaped. Only the worker that seized
+// a tracee may wait for it.
+void ptrace_backend::drain(partition* part) {
+  int status = 0;
+  while (true) {
+    pid_t tid = ::waitpid(-1, &status, __WALL | WNOHANG | __WNOTHREAD);
+    if (tid <= 0) {
+      break;
+    }
+    if (WIFSTOPPED(status)) {
+      // a thread stopped for a signal runs its handler next, its cached
+      // stack is stale even if its cpu time has not advanced yet
+      resume((uint32_t)tid, status);
+      part->idle_stacks.erase((uint32_t)tid);
+    } else if (auto it = part->threads.find((uint32_t)tid);
+               it != part->threads.end()) {
+      release(&it->second);
+      part->threads.erase(it);
+    }
+  }
+}
+
+// Stops |tid|, reads its registers and copies the top of its stack into
+// |part->stack|, then lets it run again. |timestamp| is when it stopped.
+bool ptrace_backend::interrupt(partition* part,
+                               uint32_t tid,
+                               registers* regs,
+                               size_t* copied,
+                               uint64_t* timestamp) {
+  if (::ptrace(PTRACE_INTERRUPT, tid, nullptr, nullptr) != 0) {
+    return false;
+  }
+
+  // a signal may arrive before the interrupt, it is delivered and the
+  // interrupt waited for again
+  int status = 0;
+  while (true) {
+    if (::waitpid(tid, &status, __WALL) != (pid_t)tid) {
+      return false;
+    }
+    if (!WIFSTOPPED(status)) {
+      return false;  // exited, rescan() drops it
+    }
+    if (status >> 16 == PTRACE_EVENT_STOP) {
+      break;
+    }
+    resume(tid, status);
+  }
+  *timestamp = ::timestamp();
+
+  bool ok = get_registers(tid, regs);
+  if (ok && copied) {
+    iovec local{.iov_base = part->stack.data(), .iov_len = part->stack.size()};
+    iovec remote{.iov_base = (void*)regs->sp, .iov_len = part->stack.size()};
+    ssize_t ret = ::process_vm_readv(pid_, &local, 1, &remote, 1, 0);
+    *copied = ret > 0 ? (size_t)ret : 0;
+  }
+  resume(tid, status);
+  return ok;
+}
+
+// Follows threads created and exited since the last scan.
+void ptrace_backend::rescan() {
+  std::set<uint32_t> tids = list_threads(pid_);
+  pool_->run([&](int worker) {
+    auto& part = partitions_[worker];
+    for (auto it = part.threads.begin(); it != part.threads.end();) {
+      if (!tids.contains(it->first)) {
+        release(&it->second);
+        it = part.threads.erase(it);
+      } else {
+        ++it;
+      }
+    }
+    for (uint32_t tid : tids) {
+      if (owner(tid) == worker && !part.threads.contains(tid)) {
+        seize(&part, tid);
+      }
+    }
+
+    part.idle_stacks.retain(part.threads);
+    part.suffixes.retain(part.threads);
+
+    // refresh cpu time
+    for (auto& [tid, state] : part.threads) {
+      state.cycles = read_schedstat(state.schedstat);
+    }
+  });
+}
+
+// Walks the saved frame pointer chain inside the copied stack. A frame record
+// is [saved fp, return address] on both x86_64 and aarch64.
+std::vector<tracer::stack_frame> ptrace_backend::unwind(const partition& part,
+                                                        uint32_t tid,
+                                                        const registers& regs,
+                                                        size_t copied,
+                                                        int max_frames) {
+  std::vector<tracer::stack_frame> sfs;
+  uint64_t pc = regs.pc;
+  uint64_t fp = regs.fp;
+  uint64_t sp = regs.sp;
+  while ((int)sfs.size() < max_frames) {
+    tracer::stack_frame sf{};
+    sf.instruction_offset = pc;
+    sf.frame_offset = fp;
+    sf.stack_offset = sp;
+    sf.frame_number = (uint32_t)sfs.size();
+
+    bool next = fp >= regs.sp && fp + 16 <= regs.sp + copied && fp >= sp;
+    if (next) {
+      const uint8_t* record = part.stack.data() + (fp - regs.sp);
+      uint64_t saved_fp = 0, return_offset = 0;
+      std::memcpy(&saved_fp, record, 8);
+      std::memcpy(&return_offset, record + 8, 8);
+      sf.return_offset = return_offset;
+      sp = fp + 16;
+      pc = return_offset;
+      next = return_offset != 0;
+      fp = saved_fp;
+    }
+    sfs.push_back(sf);
+    if (!next) {
+      break;
+    }
+
+    // the callers are the same as in the previous sample
+    if (splice_stacks_ && part.suffixes.splice(tid, sf, max_frames, &sfs)) {
+      break;
+    }
+  }
+  return sfs;
+}
+
+void ptrace_backend::sample(tracer::frame_budget* budget,
+                            std::vector<tracer::thread>* threads,
+                            std::vector<tracer::thread_sample>* samples) {
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_rescan_ >= kRescanInterval) {
+    rescan();
+    last_rescan_ = now;
+  }
+
+  pool_->run([&](int worker) { capture(&partitions_[worker], budget); });
+
+  for (auto& part : partitions_) {
+    std::move(part.captured.begin(), part.captured.end(),
+              std::back_inserter(*threads));
+    std::move(part.samples.begin(), part.samples.end(),
+              std::back_inserter(*samples));
+    part.captured.clear();
+    part.samples.clear();
+  }
+}
+
+// Stops are still collected while paused, a thread stopped for a signal
+// would wait for the next sample otherwise.
+void ptrace_backend::idle() {
+  pool_->run([&](int worker) { drain(&partitions_[worker]); });
+}
+
+void ptrace_backend::capture(partition* part, tracer::frame_budget* budget) {
+  drain(part);
+
+  // start after the last thread captured in the previous round
+  auto first = part->threads.lower_bound(part->first_thread);
+  bool exhausted = false;
+  for (size_t n = 0; n < part->threads.size(); ++n, ++first) {
+    if (first == part->threads.end()) {
+      first = part->threads.begin();
+    }
+    auto& [tid, state] = *first;
+    int depth = budget->depth(tid);
+    if (depth == 0 && !exhausted) {
+      exhausted = true;
+      part->first_thread = tid;
+    }
+
+    // a thread that has not run still has the same stack; drain() resumed
+    // and forgot the stack of any thread that was stopped
+    const std::vector<tracer::stack_frame>* cached = nullptr;
+    if (skip_idle_) {
+      state.cycles = read_schedstat(state.schedstat);
+      cached = part->idle_stacks.find(tid, state.cycles, std::max(depth, 1));
+    }
+
+    std::vector<tracer::stack_frame> sf;
+    uint64_t timestamp = 0;
+    if (cached) {
+      sf = *cached;
+      timestamp = ::timestamp();
+    } else {
+      // the stack is only copied when more than the pc is needed
+      registers regs{};
+      size_t copied = 0;
+      if (!interrupt(part, tid, &regs, depth > 1 ? &copied : nullptr,
+                     &timestamp)) {
+        continue;
+      }
+
+      // the thread is running again, unwind on the local copy
+      sf = unwind(*part, tid, regs, copied, std::max(depth, 1));
+      if (splice_stacks_ && depth > 1) {
+        part->suffixes.store(tid, sf);
+      }
+      if (skip_idle_) {
+        // being interrupted wakes the thread up, which costs cpu time too
+        state.cycles = read_schedstat(state.schedstat);
+        part->idle_stacks.store(tid, state.cycles, std::max(depth, 1), sf);
+      }
+    }
+    part->captured.push_back(tracer::thread{
+        .id = tid,
+        .cycles = state.cycles,
+        .instruction_offset = sf[0].instruction_offset,
+        .idle = cached != nullptr,
+    });
+    if (depth == 0) {
+      continue;
+    }
+    if (!cached) {
+      budget->consume(tid, sf.size());
+    }
+    part->samples.push_back(tracer::thread_sample{
+        .id = tid,
+        .timestamp = timestamp,
+        .idle = cached != nullptr,
+        .stack_frames = std::move(sf),
+    });
+  }
+}
+
+bool ptrace_backend::lookup(uint64_t instruction_offset,
+                            tracer::symbol* symbol) {
+  return symbolizer_.lookup(instruction_offset, symbol);
+}
+
+bool ptrace_backend::lookup_line(uint64_t instruction_offset,
+                                 tracer::symbol* symbol) {
+  return symbolizer_.lookup_line(instruction_offset, symbol);
+}
+
+void ptrace_backend::poll_modules(std::vector<tracer::mapped_range>* ranges) {
+  symbolizer_.poll(ranges);
+}
+
+}  // namespace
+
+std::unique_ptr<tracer::backend> create_ptrace_backend() {
+  return std::make_unique<ptrace_backend>();
+}
+
+#endif  // defined(__linux__)
@@ -0,0 +1,93 @@
+// Compares the aggregate tables against the std::map they replaced.
+// Counts (tid, address) updates the way the sampling loop does, with a few
+// million distinct addresses spread over a handful of threads.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "flat_map.h"
+
+namespace {
+
+constexpr int kThreads = 8;
+constexpr int kUpdates = 10'000'000;
+
+struct update {
+  uint32_t tid;
+  uint64_t address;
+};
+
+std::vector<update> generate(size_t addresses) {
+  std::mt19937_64 rng(42);
+  std::vector<uint64_t> pool(addresses);
+  for (auto& address : pool) {
+    address = 0x7f0000000000ull + (rng() & 0xffffffffffull);
+  }
+
+  // every address once, then skewed towards a hot set like real profiles
+  std::vector<update> updates;
+  updates.reserve(addresses + kUpdates);
+  for (size_t i = 0; i < addresses; ++i) {
+    updates.push_back({(uint32_t)(i % kThreads), pool[i]});
+  }
+  std::geometric_distribution<size_t> hot(8.0 / addresses);
+  for (int i = 0; i < kUpdates; ++i) {
+    size_t n = hot(rng) % addresses;
+    updates.push_back({(uint32_t)(n % kThreads), pool[n]});
+  }
+  return updates;
+}
+
+template <typename F>
+double measure(const std::vector<update>& updates, F&& fn) {
+  auto start = std::chrono::steady_clock::now();
+  for (const auto& u : updates) {
+    fn(u);
+  }
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+  return elapsed.count() / updates.size();
+}
+
+}  // namespace
+
+int main() {
+  for (size_t addresses : {1'000'000, 2'000'000, 4'000'000}) {
+    auto updates = generate(addresses);
+
+    std::map<uint32_t, std::map<uint64_t, uint64_t>> tree;
+    double tree_ns = measure(updates, [&](const update& u) {
+      tree[u.tid][u.address]++;
+    });
+
+    std::unordered_map<uint32_t, flat_map<uint64_t, uint64_t>> flat;
+    double flat_ns = measure(updates, [&](const update& u) {
+      flat[u.tid][u.address]++;
+    });
+
+    // both must agree before the numbers mean anything
+    for (const auto& [tid, counts] : tree) {
+      if (flat[tid].size() != counts.size()) {
+        std::fprintf(stderr, "size mismatch for thread %u\n", tid);
+        return EXIT_FAILURE;
+      }
+      for (const auto& [address, count] : counts) {
+        const uint64_t* value = flat[tid].find(address);
+        if (!value || *value != count) {
+          std::fprintf(stderr, "count mismatch for thread %u\n", tid);
+          return EXIT_FAILURE;
+        }
+      }
+    }
+
+    std::printf("%zu addresses: std::map %.1f ns, flat_map %.1f ns (%.1fx)\n",
+                addresses, tree_ns, flat_ns, tree_ns / flat_ns);
+  }
+  return EXIT_SUCCESS;
+}
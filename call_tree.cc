@@ -0,0 +1,36 @@
+#include "call_tree.h"
+
+call_tree::call_tree() {
+  nodes_.push_back(node{
+      .instruction_offset = 0,
+      .parent = kRoot,
+      .total = 0,
+      .self = 0,
+  });
+}
+
+uint32_t call_tree::child(uint32_t parent, uint64_t instruction_offset) {
+  // the root is never a child, so it marks a new entry
+  uint32_t& id = children_[edge{parent, instruction_offset}];
+  if (id == kRoot) {
+    id = (uint32_t)nodes_.size();
+    nodes_.push_back(node{
+        .instruction_offset = instruction_offset,
+        .parent = parent,
+        .total = 0,
+        .self = 0,
+    });
+  }
+  return id;
+}
+
+void call_tree::add(uint32_t id, uint64_t count) {
+  nodes_[id].self += count;
+  while (true) {
+    nodes_[id].total += count;
+    if (id == kRoot) {
+      break;
+    }
+    id = nodes_[id].parent;
+  }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <json.hpp>
+
+#include "flat_map.h"
+
+// Calling-context tree of one thread. Each node is a frame reached through a
+// particular chain of callers, so the same function called from two places
+// gets two nodes. Nodes are interned by (parent, instruction offset) and
+// only ever appended, so a parent always precedes its children.
+class call_tree {
+ public:
+  static constexpr uint32_t kRoot = 0;
+
+  struct node {
+    uint64_t instruction_offset;
+    uint32_t parent;
+    uint64_t total;  // samples at or below this node
+    uint64_t self;   // samples ending at this node
+  };
+
+  call_tree();
+
+  // Returns the child of |parent| for |instruction_offset|, adding it if
+  // this call path has not been seen before.
+  uint32_t child(uint32_t parent, uint64_t instruction_offset);
+
+  // Counts a sample whose innermost frame is |id|.
+  void add(uint32_t id, uint64_t count = 1);
+
+  const std::vector<node>& nodes() const { return nodes_; }
+
+ private:
+  struct edge {
+    uint32_t parent;
+    uint64_t instruction_offset;
+
+    bool operator==(const edge&) const = default;
+  };
+  struct edge_hash {
+    uint64_t operator()(const edge& e) const {
+      return flat_hash<uint64_t>{}(e.instruction_offset ^
+                                   ((uint64_t)e.parent << 40));
+    }
+  };
+
+  std::vector<node> nodes_;
+  flat_map<edge, uint32_t, edge_hash> children_;
+};
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(call_tree::node,
+                                   instruction_offset,
+                                   parent,
+                                   total,
+                                   self)
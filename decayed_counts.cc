@@ -0,0 +1,37 @@
+#include "decayed_counts.h"
+
+namespace {
+
+constexpr double kMaxWeight = 1ull << 32;  // rebase after 32 half lives
+constexpr double kMinScore = 1e-3;
+
+}  // namespace
+
+void decayed_counts::reset(double half_life) {
+  half_life_ = half_life;
+  epoch_ = 0;
+  scores_.clear();
+}
+
+void decayed_counts::add(double seconds,
+                         uint32_t thread_id,
+                         uint32_t stack_id) {
+  if (scores_.empty()) {
+    epoch_ = seconds;
+  }
+  double weight = std::exp2((seconds - epoch_) / half_life_);
+  if (weight > kMaxWeight) {
+    rebase(seconds);
+    weight = 1;
+  }
+  scores_[thread_id][stack_id] += weight;
+}
+
+void decayed_counts::rebase(double seconds) {
+  double scale = std::exp2(-(seconds - epoch_) / half_life_);
+  for (auto& [thread_id, scores] : scores_) {
+    scores.for_each([&](uint32_t, double& score) { score *= scale; });
+    scores.erase_if([](uint32_t, double score) { return score < kMinScore; });
+  }
+  epoch_ = seconds;
+}
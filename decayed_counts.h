@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <unordered_map>
+
+#include "flat_map.h"
+
+// Sample counts per (thread, stack) that halve every |half_life| seconds.
+// Instead of decaying every entry on each tick, a sample at time t is added
+// with weight 2^((t - epoch) / half_life) and the common factor is divided
+// out when reading. Once the weights grow large every entry is rebased to a
+// new epoch and those that decayed away are dropped.
+class decayed_counts {
+ public:
+  // Drops all scores.
+  void reset(double half_life);
+
+  double half_life() const { return half_life_; }
+
+  // |seconds| is a monotonic clock.
+  void add(double seconds, uint32_t thread_id, uint32_t stack_id);
+
+  // Calls |fn(stack_id, score)| with scores decayed to |seconds|.
+  template <typename F>
+  void for_each(uint32_t thread_id, double seconds, F&& fn) const {
+    auto it = scores_.find(thread_id);
+    if (it == scores_.end()) {
+      return;
+    }
+    double scale = std::exp2(-(seconds - epoch_) / half_life_);
+    it->second.for_each(
+        [&](uint32_t id, double score) { fn(id, score * scale); });
+  }
+
+ private:
+  void rebase(double seconds);
+
+  double half_life_ = 0;
+  double epoch_ = 0;
+  std::unordered_map<uint32_t, flat_map<uint32_t, double>> scores_;
+};
@@ -0,0 +1,229 @@
+#include "dwarf.h"
+
+namespace dwarf {
+
+namespace {
+
+constexpr uint64_t kLnctPath = 1;
+constexpr uint64_t kLnctDirectoryIndex = 2;
+
+}  // namespace
+
+bool read_value(reader& r,
+                uint64_t form,
+                int64_t implicit_const,
+                const unit_format& format,
+                const sections& sections,
+                value* v) {
+  auto offset = [&] { return format.dwarf64 ? r.u64() : r.u32(); };
+  *v = value{.form = form, .data = 0, .str = {}};
+  switch (form) {
+    case kFormAddr: v->data = r.fixed(format.address_size); break;
+    case kFormBlock2: r.skip(r.u16()); break;
+    case kFormBlock4: r.skip(r.u32()); break;
+    case kFormData2: v->data = r.u16(); break;
+    case kFormData4: v->data = r.u32(); break;
+    case kFormData8: v->data = r.u64(); break;
+    case kFormString: v->str = r.str(); break;
+    case kFormBlock: r.skip(r.uleb()); break;
+    case kFormBlock1: r.skip(r.u8()); break;
+    case kFormData1: v->data = r.u8(); break;
+    case kFormFlag: v->data = r.u8(); break;
+    case kFormSdata: v->data = (uint64_t)r.sleb(); break;
+    case kFormStrp: v->str = string_at(sections.str, offset()); break;
+    case kFormUdata: v->data = r.uleb(); break;
+    case kFormRefAddr:
+      // an address sized offset before DWARF 3
+      v->data = format.version <= 2 ? r.fixed(format.address_size) : offset();
+      break;
+    case kFormRef1: v->data = r.u8(); break;
+    case kFormRef2: v->data = r.u16(); break;
+    case kFormRef4: v->data = r.u32(); break;
+    case kFormRef8: v->data = r.u64(); break;
+    case kFormRefUdata: v->data = r.uleb(); break;
+    case kFormIndirect:
+      return read_value(r, r.uleb(), implicit_const, format, sections, v);
+    case kFormSecOffset: v->data = offset(); break;
+    case kFormExprloc: r.skip(r.uleb()); break;
+    case kFormFlagPresent: v->data = 1; break;
+    case kFormStrx: v->data = r.uleb(); break;
+    case kFormAddrx: v->data = r.uleb(); break;
+    case kFormRefSup4: v->data = r.u32(); break;
+    case kFormStrpSup: offset(); break;
+    case kFormData16: r.skip(16); break;
+    case kFormLineStrp: v->str = string_at(sections.line_str, offset()); break;
+    case kFormRefSig8: v->data = r.u64(); break;
+    case kFormImplicitConst: v->data = (uint64_t)implicit_const; break;
+    case kFormLoclistx: v->data = r.uleb(); break;
+    case kFormRnglistx: v->data = r.uleb(); break;
+    case kFormRefSup8: v->data = r.u64(); break;
+    case kFormStrx1: v->data = r.u8(); break;
+    case kFormStrx2: v->data = r.u16(); break;
+    case kFormStrx3: v->data = r.fixed(3); break;
+    case kFormStrx4: v->data = r.u32(); break;
+    case kFormAddrx1: v->data = r.u8(); break;
+    case kFormAddrx2: v->data = r.u16(); break;
+    case kFormAddrx3: v->data = r.fixed(3); break;
+    case kFormAddrx4: v->data = r.u32(); break;
+    case kFormGnuAddrIndex: v->data = r.uleb(); break;
+    case kFormGnuStrIndex: v->data = r.uleb(); break;
+    case kFormGnuRefAlt: offset(); break;
+    case kFormGnuStrpAlt: offset(); break;
+    default: return false;
+  }
+  return r.ok;
+}
+
+std::string_view string_at(std::span<const uint8_t> section, uint64_t offset) {
+  if (offset >= section.size()) {
+    return {};
+  }
+  reader r(section.subspan(offset));
+  return r.str();
+}
+
+std::span<const uint8_t> unit_at(std::span<const uint8_t> section,
+                                 uint64_t offset) {
+  if (offset >= section.size()) {
+    return {};
+  }
+  reader r(section.subspan(offset));
+  uint64_t length = r.u32();
+  size_t header = 4;
+  if (length == 0xffffffff) {
+    length = r.u64();
+    header = 12;
+  }
+  if (!r.ok || length > (uint64_t)(r.end - r.p)) {
+    return {};
+  }
+  return section.subspan(offset, header + length);
+}
+
+std::string join_path(std::string_view directory, std::string_view name) {
+  if (directory.empty() || name.starts_with('/')) {
+    return std::string(name);
+  }
+  std::string path(directory);
+  if (!path.ends_with('/')) {
+    path += '/';
+  }
+  path += name;
+  return path;
+}
+
+bool read_line_header(std::span<const uint8_t> unit,
+                      const sections& sections,
+                      line_header* header) {
+  reader r(unit);
+  header->dwarf64 = r.u32() == 0xffffffff;
+  if (header->dwarf64) {
+    r.u64();
+  }
+  auto offset = [&] { return header->dwarf64 ? r.u64() : r.u32(); };
+
+  header->version = r.u16();
+  if (header->version < 2 || header->version > 5) {
+    return false;
+  }
+  unit_format format{
+      .version = header->version,
+      .dwarf64 = header->dwarf64,
+      .address_size = 8,
+  };
+  if (header->version >= 5) {
+    format.address_size = r.u8();
+    r.u8();  // segment_selector_size
+  }
+  uint64_t header_length = offset();
+  if (header_length > (uint64_t)(r.end - r.p)) {
+    return false;
+  }
+  header->program = {r.p + header_length, r.end};
+  header->min_instruction_length = r.u8();
+  if (header->version >= 4) {
+    r.u8();  // maximum_operations_per_instruction
+  }
+  r.u8();  // default_is_stmt
+  header->line_base = (int8_t)r.u8();
+  header->line_range = r.u8();
+  header->opcode_base = r.u8();
+  if (!r.ok || header->line_range == 0 || header->opcode_base == 0) {
+    return false;
+  }
+  header->opcode_lengths.assign(header->opcode_base, 0);
+  for (int i = 1; i < header->opcode_base; ++i) {
+    header->opcode_lengths[i] = r.u8();
+  }
+
+  header->directories.clear();
+  header->files.clear();
+  if (header->version < 5) {
+    // the compilation directory is implicit and not known here
+    header->directories.emplace_back();
+    while (true) {
+      std::string_view directory = r.str();
+      if (!r.ok || directory.empty()) {
+        break;
+      }
+      header->directories.emplace_back(directory);
+    }
+    header->files.emplace_back();  // indices start at 1
+    while (true) {
+      std::string_view name = r.str();
+      if (!r.ok || name.empty()) {
+        break;
+      }
+      uint64_t directory = r.uleb();
+      r.uleb();  // mtime
+      r.uleb();  // length
+      header->files.push_back(join_path(
+          directory < header->directories.size()
+              ? std::string_view(header->directories[directory])
+              : std::string_view(),
+          name));
+    }
+    return r.ok;
+  }
+
+  // entries are described by (content type, form) pairs
+  auto entries = [&](auto&& fn) -> bool {
+    std::vector<std::pair<uint64_t, uint64_t>> formats(r.u8());
+    for (auto& [type, form] : formats) {
+      type = r.uleb();
+      form = r.uleb();
+    }
+    uint64_t count = r.uleb();
+    for (uint64_t i = 0; i < count && r.ok; ++i) {
+      std::string_view path;
+      uint64_t directory = 0;
+      for (auto [type, form] : formats) {
+        value v;
+        // strx needs the base from .debug_info, not supported
+        if (!read_value(r, form, 0, format, sections, &v) ||
+            form == kFormStrx || (form >= kFormStrx1 && form <= kFormStrx4)) {
+          return false;
+        }
+        if (type == kLnctPath) {
+          path = v.str;
+        } else if (type == kLnctDirectoryIndex) {
+          directory = v.data;
+        }
+      }
+      fn(path, directory);
+    }
+    return r.ok;
+  };
+  return entries([&](std::string_view path, uint64_t) {
+           header->directories.emplace_back(path);
+         }) &&
+         entries([&](std::string_view path, uint64_t directory) {
+           header->files.push_back(join_path(
+               directory < header->directories.size()
+                   ? std::string_view(header->directories[directory])
+                   : std::string_view(),
+               path));
+         });
+}
+
+}  // namespace dwarf
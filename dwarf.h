@@ -0,0 +1,228 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Pieces of DWARF decoding shared by line_table and inline_table.
+namespace dwarf {
+
+// debug sections of one module, empty when missing
+struct sections {
+  std::span<const uint8_t> info;
+  std::span<const uint8_t> abbrev;
+  std::span<const uint8_t> line;
+  std::span<const uint8_t> line_str;
+  std::span<const uint8_t> str;
+  std::span<const uint8_t> str_offsets;
+  std::span<const uint8_t> addr;
+  std::span<const uint8_t> ranges;
+  std::span<const uint8_t> rnglists;
+};
+
+// attribute forms
+constexpr uint64_t kFormAddr = 0x01;
+constexpr uint64_t kFormBlock2 = 0x03;
+constexpr uint64_t kFormBlock4 = 0x04;
+constexpr uint64_t kFormData2 = 0x05;
+constexpr uint64_t kFormData4 = 0x06;
+constexpr uint64_t kFormData8 = 0x07;
+constexpr uint64_t kFormString = 0x08;
+constexpr uint64_t kFormBlock = 0x09;
+constexpr uint64_t kFormBlock1 = 0x0a;
+constexpr uint64_t kFormData1 = 0x0b;
+constexpr uint64_t kFormFlag = 0x0c;
+constexpr uint64_t kFormSdata = 0x0d;
+constexpr uint64_t kFormStrp = 0x0e;
+constexpr uint64_t kFormUdata = 0x0f;
+constexpr uint64_t kFormRefAddr = 0x10;
+constexpr uint64_t kFormRef1 = 0x11;
+constexpr uint64_t kFormRef2 = 0x12;
+constexpr uint64_t kFormRef4 = 0x13;
+constexpr uint64_t kFormRef8 = 0x14;
+constexpr uint64_t kFormRefUdata = 0x15;
+constexpr uint64_t kFormIndirect = 0x16;
+constexpr uint64_t kFormSecOffset = 0x17;
+constexpr uint64_t kFormExprloc = 0x18;
+constexpr uint64_t kFormFlagPresent = 0x19;
+constexpr uint64_t kFormStrx = 0x1a;
+constexpr uint64_t kFormAddrx = 0x1b;
+constexpr uint64_t kFormRefSup4 = 0x1c;
+constexpr uint64_t kFormStrpSup = 0x1d;
+constexpr uint64_t kFormData16 = 0x1e;
+constexpr uint64_t kFormLineStrp = 0x1f;
+constexpr uint64_t kFormRefSig8 = 0x20;
+constexpr uint64_t kFormImplicitConst = 0x21;
+constexpr uint64_t kFormLoclistx = 0x22;
+constexpr uint64_t kFormRnglistx = 0x23;
+constexpr uint64_t kFormRefSup8 = 0x24;
+constexpr uint64_t kFormStrx1 = 0x25;
+constexpr uint64_t kFormStrx2 = 0x26;
+constexpr uint64_t kFormStrx3 = 0x27;
+constexpr uint64_t kFormStrx4 = 0x28;
+constexpr uint64_t kFormAddrx1 = 0x29;
+constexpr uint64_t kFormAddrx2 = 0x2a;
+constexpr uint64_t kFormAddrx3 = 0x2b;
+constexpr uint64_t kFormAddrx4 = 0x2c;
+constexpr uint64_t kFormGnuAddrIndex = 0x1f01;
+constexpr uint64_t kFormGnuStrIndex = 0x1f02;
+constexpr uint64_t kFormGnuRefAlt = 0x1f20;
+constexpr uint64_t kFormGnuStrpAlt = 0x1f21;
+
+// Bounds checked little endian reader. Reading past the end yields zeros
+// and clears ok.
+struct reader {
+  const uint8_t* p;
+  const uint8_t* end;
+  bool ok = true;
+
+  explicit reader(std::span<const uint8_t> data)
+      : p(data.data()), end(data.data() + data.size()) {}
+
+  bool done() const { return p >= end; }
+
+  uint64_t fixed(size_t size) {
+    if (size > 8 || (size_t)(end - p) < size) {
+      ok = false;
+      p = end;
+      return 0;
+    }
+    uint64_t value = 0;
+    std::memcpy(&value, p, size);
+    p += size;
+    return value;
+  }
+  uint8_t u8() { return (uint8_t)fixed(1); }
+  uint16_t u16() { return (uint16_t)fixed(2); }
+  uint32_t u32() { return (uint32_t)fixed(4); }
+  uint64_t u64() { return fixed(8); }
+
+  uint64_t uleb() {
+    uint64_t value = 0;
+    for (int shift = 0; p < end; shift += 7) {
+      uint8_t byte = *p++;
+      if (shift < 64) {
+        value |= (uint64_t)(byte & 0x7f) << shift;
+      }
+      if (!(byte & 0x80)) {
+        return value;
+      }
+    }
+    ok = false;
+    return value;
+  }
+
+  int64_t sleb() {
+    int64_t value = 0;
+    int shift = 0;
+    while (p < end) {
+      uint8_t byte = *p++;
+      if (shift < 64) {
+        value |= (int64_t)(byte & 0x7f) << shift;
+      }
+      shift += 7;
+      if (!(byte & 0x80)) {
+        if (shift < 64 && (byte & 0x40)) {
+          value |= -((int64_t)1 << shift);
+        }
+        return value;
+      }
+    }
+    ok = false;
+    return value;
+  }
+
+  std::string_view str() {
+    const uint8_t* terminator = (const uint8_t*)std::memchr(p, 0, end - p);
+    if (!terminator) {
+      ok = false;
+      p = end;
+      return {};
+    }
+    std::string_view s((const char*)p, terminator - p);
+    p = terminator + 1;
+    return s;
+  }
+
+  void skip(uint64_t size) {
+    if ((uint64_t)(end - p) < size) {
+      ok = false;
+      p = end;
+      return;
+    }
+    p += size;
+  }
+};
+
+// Value of one attribute. Strings in the string sections are resolved,
+// indices into .debug_str_offsets or .debug_addr and references are left
+// for the caller as they depend on the unit.
+struct value {
+  uint64_t form;
+  uint64_t data;
+  std::string_view str;
+};
+
+struct unit_format {
+  uint16_t version;
+  bool dwarf64;
+  uint8_t address_size;
+};
+
+// Reads a value of |form|. Returns false for forms it cannot skip.
+bool read_value(reader& r,
+                uint64_t form,
+                int64_t implicit_const,
+                const unit_format& format,
+                const sections& sections,
+                value* v);
+
+// Returns the string at |offset| of a string section.
+std::string_view string_at(std::span<const uint8_t> section, uint64_t offset);
+
+// Returns the unit at |offset| of |section|, including its initial length
+// field, or an empty span if it is truncated.
+std::span<const uint8_t> unit_at(std::span<const uint8_t> section,
+                                 uint64_t offset);
+
+// Calls |fn(unit)| with each unit of |section|.
+template <typename F>
+void for_each_unit(std::span<const uint8_t> section, F&& fn) {
+  for (uint64_t offset = 0; offset < section.size();) {
+    std::span<const uint8_t> unit = unit_at(section, offset);
+    if (unit.empty()) {
+      return;
+    }
+    fn(unit);
+    offset += unit.size();
+  }
+}
+
+// Header of a line number program.
+struct line_header {
+  uint16_t version;
+  bool dwarf64;
+  uint8_t min_instruction_length;
+  int8_t line_base;
+  uint8_t line_range;
+  uint8_t opcode_base;
+  std::vector<uint8_t> opcode_lengths;
+  std::vector<std::string> directories;
+  // paths by the index the program refers to them with, joined with their
+  // directory
+  std::vector<std::string> files;
+  std::span<const uint8_t> program;
+};
+
+// Reads the header of the line number program |unit|.
+bool read_line_header(std::span<const uint8_t> unit,
+                      const sections& sections,
+                      line_header* header);
+
+// Joins a directory and a file name of a line number program.
+std::string join_path(std::string_view directory, std::string_view name);
+
+}  // namespace dwarf
@@ -0,0 +1,531 @@
+#if defined(__linux__)
+
+#include "elf_symbolizer.h"
+
+#include <cxxabi.h>
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// /proc/<pid>/maps is read again at most this often when an address is in
+// no known mapping
+constexpr auto kRereadInterval = std::chrono::milliseconds(100);
+
+std::string demangle(const char* name) {
+  int status = 0;
+  char* demangled = abi::__cxa_demangle(name, nullptr, nullptr, &status);
+  if (status != 0 || !demangled) {
+    return name;
+  }
+  std::string result = demangled;
+  std::free(demangled);
+  return result;
+}
+
+}  // namespace
+
+std::unique_ptr<elf_module> elf_module::open(const std::string& path,
+                                             const std::string& name) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st {};
+  void* data = MAP_FAILED;
+  if (::fstat(fd, &st) == 0 && st.st_size > 0) {
+    data = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+
+  std::unique_ptr<elf_module> module(new elf_module());
+  module->data_ = (const uint8_t*)data;
+  module->size_ = (size_t)st.st_size;
+  const std::string& named = name.empty() ? path : name;
+  module->file_name_ = named.substr(named.rfind('/') + 1);
+  if (!module->parse()) {
+    return nullptr;
+  }
+  return module;
+}
+
+elf_module::~elf_module() {
+  if (data_) {
+    ::munmap((void*)data_, size_);
+  }
+}
+
+// Every offset and count is checked against the file size, the file may be
+// truncated or replaced while the target runs.
+bool elf_module::parse() {
+  if (size_ < sizeof(Elf64_Ehdr)) {
+    return false;
+  }
+  const auto* ehdr = (const Elf64_Ehdr*)data_;
+  if (std::memcmp(ehdr->e_ident, ELFMAG, SELFMAG) != 0 ||
+      ehdr->e_ident[EI_CLASS] != ELFCLASS64) {
+    return false;
+  }
+
+  if (ehdr->e_phentsize == sizeof(Elf64_Phdr) && ehdr->e_phoff < size_ &&
+      ehdr->e_phnum <= (size_ - ehdr->e_phoff) / sizeof(Elf64_Phdr)) {
+    const auto* phdrs = (const Elf64_Phdr*)(data_ + ehdr->e_phoff);
+    for (int i = 0; i < ehdr->e_phnum; ++i) {
+      if (phdrs[i].p_type == PT_LOAD) {
+        segments_.push_back(segment{
+            .offset = phdrs[i].p_offset,
+            .size = phdrs[i].p_filesz,
+            .address = phdrs[i].p_vaddr,
+            .executable = (phdrs[i].p_flags & PF_X) != 0,
+        });
+      }
+    }
+  }
+
+  if (ehdr->e_shentsize != sizeof(Elf64_Shdr) || ehdr->e_shoff >= size_ ||
+      ehdr->e_shnum > (size_ - ehdr->e_shoff) / sizeof(Elf64_Shdr) ||
+      ehdr->e_shstrndx >= ehdr->e_shnum) {
+    return !segments_.empty();
+  }
+  const auto* shdrs = (const Elf64_Shdr*)(data_ + ehdr->e_shoff);
+  auto contents = [&](const Elf64_Shdr& shdr) -> std::span<const uint8_t> {
+    // compressed debug sections are not supported
+    if (shdr.sh_type == SHT_NOBITS || (shdr.sh_flags & SHF_COMPRESSED) ||
+        shdr.sh_offset > size_ ||
+        shdr.sh_size > size_ - shdr.sh_offset) {
+      return {};
+    }
+    return {data_ + shdr.sh_offset, (size_t)shdr.sh_size};
+  };
+  auto names = contents(shdrs[ehdr->e_shstrndx]);
+  for (int i = 0; i < ehdr->e_shnum; ++i) {
+    if (shdrs[i].sh_name >= names.size()) {
+      continue;
+    }
+    const char* name = (const char*)names.data() + shdrs[i].sh_name;
+    size_t length = strnlen(name, names.size() - shdrs[i].sh_name);
+    sections_.emplace_back(std::string_view(name, length),
+                           contents(shdrs[i]));
+  }
+
+  read_build_id();
+  cache_ = symbol_cache::open(symbol_cache::path(build_id_));
+  if (cache_ && load_functions(*cache_)) {
+    return true;
+  }
+
+  // .dynsym is a subset of .symtab, only needed for stripped files
+  for (uint32_t type : {SHT_SYMTAB, SHT_DYNSYM}) {
+    for (int i = 0; i < ehdr->e_shnum && names_.empty(); ++i) {
+      if (shdrs[i].sh_type == type && shdrs[i].sh_link < ehdr->e_shnum) {
+        load_symbols(contents(shdrs[i]), contents(shdrs[shdrs[i].sh_link]));
+      }
+    }
+  }
+  return true;
+}
+
+void elf_module::load_symbols(std::span<const uint8_t> symbols,
+                              std::span<const uint8_t> strings) {
+  if (strings.empty() || strings.back() != 0) {
+    return;  // names are read up to their terminator
+  }
+  const auto* syms = (const Elf64_Sym*)symbols.data();
+  size_t count = symbols.size() / sizeof(Elf64_Sym);
+  std::vector<std::pair<function, int>> found;  // by binding rank
+  for (size_t i = 0; i < count; ++i) {
+    const Elf64_Sym& sym = syms[i];
+    int type = ELF64_ST_TYPE(sym.st_info);
+    if ((type != STT_FUNC && type != STT_GNU_IFUNC) || sym.st_value == 0 ||
+        sym.st_shndx == SHN_UNDEF || sym.st_name >= strings.size()) {
+      continue;
+    }
+    int rank = ELF64_ST_BIND(sym.st_info) == STB_GLOBAL ? 0
+               : ELF64_ST_BIND(sym.st_info) == STB_WEAK ? 1
+                                                        : 2;
+    found.push_back({
+        function{
+            .address = sym.st_value,
+            .size = sym.st_size,
+            .name = (const char*)strings.data() + sym.st_name,
+            .index = 0,  // not stored
+        },
+        rank,
+    });
+  }
+
+  // of aliases at one address, keep the global one that has a size
+  std::sort(found.begin(), found.end(), [](const auto& a, const auto& b) {
+    if (a.first.address != b.first.address) {
+      return a.first.address < b.first.address;
+    }
+    if ((a.first.size == 0) != (b.first.size == 0)) {
+      return a.first.size != 0;
+    }
+    return a.second < b.second;
+  });
+  for (const auto& [f, rank] : found) {
+    if (decoded_addresses_.empty() || decoded_addresses_.back() != f.address) {
+      decoded_addresses_.push_back(f.address);
+      decoded_sizes_.push_back(f.size);
+      names_.push_back(f.name);
+    }
+  }
+  addresses_ = decoded_addresses_;
+  sizes_ = decoded_sizes_;
+  display_names_.resize(names_.size());
+}
+
+// The build id is the descriptor of the GNU note of type
+// NT_GNU_BUILD_ID.
+void elf_module::read_build_id() {
+  auto note = section(".note.gnu.build-id");
+  if (note.size() < sizeof(Elf64_Nhdr)) {
+    return;
+  }
+  const auto* nhdr = (const Elf64_Nhdr*)note.data();
+  size_t name_size = (nhdr->n_namesz + 3) & ~3u;
+  if (nhdr->n_type != NT_GNU_BUILD_ID ||
+      name_size > note.size() - sizeof(Elf64_Nhdr) ||
+      nhdr->n_descsz > note.size() - sizeof(Elf64_Nhdr) - name_size) {
+    return;
+  }
+  const uint8_t* desc = note.data() + sizeof(Elf64_Nhdr) + name_size;
+  static constexpr char kHex[] = "0123456789abcdef";
+  for (uint32_t i = 0; i < nhdr->n_descsz; ++i) {
+    build_id_ += kHex[desc[i] >> 4];
+    build_id_ += kHex[desc[i] & 0xf];
+  }
+}
+
+bool elf_module::load_functions(const symbol_cache& cache) {
+  auto addresses = cache.array<uint64_t>(symbol_cache::kFunctionAddresses);
+  auto sizes = cache.array<uint64_t>(symbol_cache::kFunctionSizes);
+  auto names = cache.strings(symbol_cache::kFunctionNames);
+  if (!cache.contains(symbol_cache::kFunctionAddresses) ||
+      sizes.size() != addresses.size() || names.size() != addresses.size() ||
+      !std::is_sorted(addresses.begin(), addresses.end())) {
+    return false;
+  }
+  addresses_ = addresses;
+  sizes_ = sizes;
+  names_.clear();
+  for (std::string_view name : names) {
+    names_.push_back(name.data());
+  }
+  display_names_.resize(names_.size());
+  return true;
+}
+
+// Lines and inlined calls are decoded together, so the cache is written
+// once with both.
+void elf_module::load_debug_info() {
+  if (lines_) {
+    return;
+  }
+  lines_ = std::make_unique<line_table>();
+  inlines_ = std::make_unique<inline_table>();
+  if (cache_ && lines_->load(*cache_) && inlines_->load(*cache_)) {
+    return;
+  }
+  lines_ = std::make_unique<line_table>();
+  inlines_ = std::make_unique<inline_table>();
+  auto sections = debug_sections();
+  lines_->build(sections);
+  inlines_->build(sections);
+  save_cache();
+}
+
+void elf_module::save_cache() const {
+  std::string path = symbol_cache::path(build_id_);
+  if (path.empty()) {
+    return;
+  }
+  std::vector<std::string_view> names(names_.begin(), names_.end());
+  symbol_cache::writer cache;
+  cache.add<uint64_t>(symbol_cache::kFunctionAddresses, addresses_);
+  cache.add<uint64_t>(symbol_cache::kFunctionSizes, sizes_);
+  cache.add_strings(symbol_cache::kFunctionNames, names);
+  lines_->save(&cache);
+  inlines_->save(&cache);
+  cache.write(path);
+}
+
+std::span<const uint8_t> elf_module::section(std::string_view name) const {
+  for (const auto& [section_name, contents] : sections_) {
+    if (section_name == name) {
+      return contents;
+    }
+  }
+  return {};
+}
+
+// Segments that share a page map at the same offset, only executable
+// mappings are symbolized so an executable segment is preferred.
+bool elf_module::segment_delta(uint64_t file_offset, int64_t* delta) const {
+  static const uint64_t page_mask = ~((uint64_t)sysconf(_SC_PAGESIZE) - 1);
+  const segment* found = nullptr;
+  for (const auto& s : segments_) {
+    if ((s.offset & page_mask) == file_offset &&
+        (!found || (s.executable && !found->executable))) {
+      found = &s;
+    }
+  }
+  if (!found) {
+    return false;
+  }
+  *delta = (int64_t)((found->address & page_mask) - file_offset);
+  return true;
+}
+
+// Symbols without a size extend up to the next one.
+bool elf_module::find_function(uint64_t address, function* f) const {
+  size_t i = std::upper_bound(addresses_.begin(), addresses_.end(), address) -
+             addresses_.begin();
+  if (i == 0) {
+    return false;
+  }
+  *f = function{
+      .address = addresses_[i - 1],
+      .size = sizes_[i - 1],
+      .name = names_[i - 1],
+      .index = i - 1,
+  };
+  return f->size == 0 || address - f->address < f->size;
+}
+
+const std::string& elf_module::display_name(const function& f) {
+  std::string& name = display_names_[f.index];
+  if (name.empty()) {
+    name = file_name_ + "!" + demangle(f.name);
+  }
+  return name;
+}
+
+dwarf::sections elf_module::debug_sections() const {
+  return dwarf::sections{
+      .info = section(".debug_info"),
+      .abbrev = section(".debug_abbrev"),
+      .line = section(".debug_line"),
+      .line_str = section(".debug_line_str"),
+      .str = section(".debug_str"),
+      .str_offsets = section(".debug_str_offsets"),
+      .addr = section(".debug_addr"),
+      .ranges = section(".debug_ranges"),
+      .rnglists = section(".debug_rnglists"),
+  };
+}
+
+const line_table& elf_module::lines() {
+  load_debug_info();
+  return *lines_;
+}
+
+const inline_table& elf_module::inlines() {
+  load_debug_info();
+  return *inlines_;
+}
+
+void elf_symbolizer::attach(uint32_t pid) {
+  pid_ = pid;
+  maps_.attach(pid);
+  jit_.attach(pid, "/proc/" + std::to_string(pid) + "/root");
+  read_mappings();
+}
+
+void elf_symbolizer::detach() {
+  maps_.detach();
+  mappings_.clear();
+  modules_.clear();
+  jit_.detach();
+}
+
+bool elf_symbolizer::lookup(uint64_t instruction_offset,
+                            tracer::symbol* symbol) {
+  const mapping* m = find_mapping(instruction_offset);
+  symbol->generation = m ? m->generation : 0;
+  if (!m || !m->module) {
+    return lookup_jit(instruction_offset, symbol);
+  }
+  uint64_t address = instruction_offset - m->bias;
+  elf_module::function f;
+  if (!m->module->find_function(address, &f)) {
+    return false;
+  }
+
+  symbol->function_name = m->module->display_name(f);
+  symbol->address = f.address + m->bias;
+  symbol->displacement = address - f.address;
+  symbol->size = f.size;
+  lookup_line(instruction_offset, symbol);
+  return true;
+}
+
+bool elf_symbolizer::lookup_line(uint64_t instruction_offset,
+                                 tracer::symbol* symbol) {
+  const mapping* m = find_mapping(instruction_offset);
+  if (!m || !m->module) {
+    return false;
+  }
+  uint64_t address = instruction_offset - m->bias;
+  std::string_view file;
+  uint32_t line = 0;
+  bool found = m->module->lines().find(address, &file, &line);
+
+  // each inlined call is shown at the line it is at, and the function it
+  // was inlined into at the call site
+  inline_frames_.clear();
+  m->module->inlines().find(address, &inline_frames_);
+  symbol->inline_frames.clear();
+  for (const auto& frame : inline_frames_) {
+    symbol->inline_frames.push_back(tracer::inline_frame{
+        .function_name = m->module->file_name() + "!" +
+                         demangle(std::string(frame.function_name).c_str()),
+        .source_name = std::string(file),
+        .source_line = line,
+    });
+    file = frame.call_file;
+    line = frame.call_line;
+    found = true;
+  }
+  if (!found) {
+    return false;
+  }
+  symbol->source_name = file;
+  symbol->source_line = line;
+  return true;
+}
+
+// Functions a JIT emitted since the previous miss are read before giving
+// up, as a failed address is not looked up again.
+bool elf_symbolizer::lookup_jit(uint64_t instruction_offset,
+                                tracer::symbol* symbol) {
+  jit_symbols::symbol s;
+  if (!jit_.find(instruction_offset, &s)) {
+    jit_.update(maps_.next_generation());
+    if (!jit_.find(instruction_offset, &s)) {
+      return false;
+    }
+  }
+  symbol->function_name = s.name;
+  symbol->address = s.start;
+  symbol->displacement = instruction_offset - s.start;
+  symbol->size = s.size;
+  symbol->generation = s.generation;
+  return true;
+}
+
+const elf_symbolizer::mapping* elf_symbolizer::find_mapping(
+    uint64_t address) {
+  if (const mapping* m = mappings_.find(address)) {
+    return m;
+  }
+  // the target may have loaded a module since
+  auto now = std::chrono::steady_clock::now();
+  if (now - last_read_ < kRereadInterval) {
+    return nullptr;
+  }
+  read_mappings();
+  return mappings_.find(address);
+}
+
+// Mappings are only parsed again when the maps file changed, and modules are
+// only opened for files not seen before.
+void elf_symbolizer::read_mappings() {
+  last_read_ = std::chrono::steady_clock::now();
+  if (!maps_.update()) {
+    return;
+  }
+
+  std::vector<const module_map::mapping*> sorted;
+  maps_.for_each([&](const module_map::mapping& mm) { sorted.push_back(&mm); });
+  std::sort(sorted.begin(), sorted.end(),
+            [](const auto* a, const auto* b) { return a->start < b->start; });
+  mappings_.clear();
+  for (const module_map::mapping* mm : sorted) {
+    mapping m{.module = nullptr, .bias = 0, .generation = mm->generation};
+    // JIT agents map their jitdump file executable so perf finds it
+    const std::string& name = mm->path;
+    std::string_view file_name(name.c_str() + name.rfind('/') + 1);
+    if (file_name.starts_with("jit-") && file_name.ends_with(".dump")) {
+      jit_.add_dump(name);
+    } else if (name.starts_with("/")) {
+      m.module = open_module(*mm);
+      int64_t delta = 0;
+      if (m.module && m.module->segment_delta(mm->offset, &delta)) {
+        m.bias = (int64_t)(mm->start - mm->offset) - delta;
+      } else {
+        m.module = nullptr;
+      }
+    }
+    mappings_.insert(mm->start, mm->end, m);
+  }
+}
+
+// Code a JIT loaded is reported like a new mapping, as it may replace code
+// whose symbols were looked up before. Ranges are listed oldest first.
+void elf_symbolizer::poll(std::vector<tracer::mapped_range>* ranges) {
+  read_mappings();
+  jit_.update(maps_.next_generation());
+  size_t first = ranges->size();
+  for (const auto& mm : maps_.take_added()) {
+    ranges->push_back(tracer::mapped_range{
+        .start = mm.start,
+        .end = mm.end,
+        .generation = mm.generation,
+    });
+  }
+  for (const auto& loaded : jit_.take_loaded()) {
+    ranges->push_back(tracer::mapped_range{
+        .start = loaded.start,
+        .end = loaded.end,
+        .generation = loaded.generation,
+    });
+  }
+  std::stable_sort(ranges->begin() + first, ranges->end(),
+                   [](const auto& a, const auto& b) {
+                     return a.generation < b.generation;
+                   });
+}
+
+// Modules are read through /proc/<pid>/root so targets in another mount
+// namespace resolve too. Files deleted since they were mapped, e.g. by a
+// package upgrade, are read through the mapping itself in
+// /proc/<pid>/map_files, as the path names another file or none. Files that
+// failed to open are not tried again.
+elf_module* elf_symbolizer::open_module(const module_map::mapping& mm) {
+  std::string key = mm.path + ":" + std::to_string(mm.dev) + ":" +
+                    std::to_string(mm.inode);
+  auto it = modules_.find(key);
+  if (it == modules_.end()) {
+    std::string proc = "/proc/" + std::to_string(pid_);
+    std::unique_ptr<elf_module> module;
+    if (!mm.deleted) {
+      module = elf_module::open(proc + "/root" + mm.path);
+      if (!module) {
+        module = elf_module::open(mm.path);
+      }
+    }
+    if (!module) {
+      char range[40];
+      std::snprintf(range, sizeof(range), "/%llx-%llx",
+                    (unsigned long long)mm.start, (unsigned long long)mm.end);
+      module = elf_module::open(proc + "/map_files" + range, mm.path);
+    }
+    it = modules_.emplace(std::move(key), std::move(module)).first;
+  }
+  return it->second.get();
+}
+
+#endif  // defined(__linux__)
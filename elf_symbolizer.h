@@ -0,0 +1,141 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarf.h"
+#include "inline_table.h"
+#include "jit_symbols.h"
+#include "line_table.h"
+#include "module_map.h"
+#include "range_table.h"
+#include "symbol_cache.h"
+#include "tracer.h"
+
+// An ELF file mapped read-only. Symbols of .symtab, or .dynsym for stripped
+// files, are collected into one array sorted by address on open. Files with
+// a build id keep what was decoded in the symbol cache, and later opens of
+// the same build read it from there.
+class elf_module {
+ public:
+  // Returns nullptr if |path| is not a readable 64-bit ELF file. Symbols
+  // are named after |name|, the file name of |path| if it is empty.
+  static std::unique_ptr<elf_module> open(const std::string& path,
+                                          const std::string& name = {});
+  ~elf_module();
+
+  elf_module(const elf_module&) = delete;
+  elf_module& operator=(const elf_module&) = delete;
+
+  // Contents of the section named |name|, empty if there is none.
+  std::span<const uint8_t> section(std::string_view name) const;
+
+  // Link-time address of the mapping at page-aligned |file_offset| minus
+  // the offset itself. The kernel maps each loadable segment from its
+  // p_offset rounded down to a page, so that is what is matched; with lld
+  // layouts the page also holds the end of the segment before it.
+  bool segment_delta(uint64_t file_offset, int64_t* delta) const;
+
+  struct function {
+    uint64_t address;  // link-time
+    uint64_t size;     // 0 if unknown
+    const char* name;  // in the mapped string table or cache
+    size_t index;      // in the symbols of the module
+  };
+  // Finds the function containing link-time address |address|.
+  bool find_function(uint64_t address, function* f) const;
+  // Demangled name of |f| prefixed with the file name, like DbgEng names
+  // it. Built on first use.
+  const std::string& display_name(const function& f);
+
+  const std::string& file_name() const { return file_name_; }
+  // GNU build id in hex, empty if the file has none.
+  const std::string& build_id() const { return build_id_; }
+
+  // Source lines from .debug_line and inlined calls from .debug_info,
+  // decoded on first use.
+  const line_table& lines();
+  const inline_table& inlines();
+
+ private:
+  elf_module() = default;
+  bool parse();
+  void read_build_id();
+  dwarf::sections debug_sections() const;
+  void load_symbols(std::span<const uint8_t> symbols,
+                    std::span<const uint8_t> strings);
+  bool load_functions(const symbol_cache& cache);
+  void load_debug_info();
+  void save_cache() const;
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  std::vector<std::pair<std::string_view, std::span<const uint8_t>>>
+      sections_;
+  struct segment {
+    uint64_t offset;
+    uint64_t size;
+    uint64_t address;
+    bool executable;
+  };
+  std::vector<segment> segments_;
+  // sorted by address, in cache_ or in the decoded arrays below
+  std::span<const uint64_t> addresses_;
+  std::span<const uint64_t> sizes_;
+  std::vector<const char*> names_;  // in the string table or cache_
+  std::vector<uint64_t> decoded_addresses_;
+  std::vector<uint64_t> decoded_sizes_;
+  std::vector<std::string> display_names_;  // by function, "" until used
+  std::unique_ptr<line_table> lines_;
+  std::unique_ptr<inline_table> inlines_;
+  std::unique_ptr<symbol_cache> cache_;
+  std::string file_name_;
+  std::string build_id_;
+};
+
+// Resolves addresses of a Linux process from the symbol tables of the
+// modules it has mapped, without any debugger library. Modules are mapped
+// once, when /proc/<pid>/maps first lists them. Addresses outside of any
+// module are looked up in the functions a JIT compiler reported. Symbols are
+// stamped with the generation of the mapping they were found in. Not thread
+// safe; backends call it from the symbolizer thread only.
+class elf_symbolizer {
+ public:
+  void attach(uint32_t pid);
+  void detach();
+
+  bool lookup(uint64_t instruction_offset, tracer::symbol* symbol);
+  bool lookup_line(uint64_t instruction_offset, tracer::symbol* symbol);
+
+  // Reads the mappings of the target again and appends those that are new
+  // since the previous call to |ranges|.
+  void poll(std::vector<tracer::mapped_range>* ranges);
+
+ private:
+  // an executable mapping of the target
+  struct mapping {
+    elf_module* module;  // nullptr for anonymous or unreadable mappings
+    int64_t bias;  // runtime minus link-time address
+    uint32_t generation;
+  };
+
+  const mapping* find_mapping(uint64_t address);
+  void read_mappings();
+  elf_module* open_module(const module_map::mapping& mm);
+  bool lookup_jit(uint64_t instruction_offset, tracer::symbol* symbol);
+
+  uint32_t pid_ = 0;
+  module_map maps_;
+  range_table<mapping> mappings_;
+  // by path and inode, a file replaced on disk is opened again
+  std::unordered_map<std::string, std::unique_ptr<elf_module>> modules_;
+  std::chrono::steady_clock::time_point last_read_;
+  jit_symbols jit_;
+  std::vector<inline_table::frame> inline_frames_;
+};
@@ -0,0 +1,290 @@
+#pragma once
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+template <typename T>
+struct flat_hash {
+  uint64_t operator()(T value) const {
+    uint64_t x = (uint64_t)value;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdull;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ull;
+    x ^= x >> 33;
+    return x;
+  }
+};
+
+// Open addressing hash map for the sample aggregates. One control byte per
+// slot holds 7 bits of the hash, so a group of 16 slots is matched with a
+// single SSE2 compare before any key is touched, and groups are probed
+// linearly. Growing moves entries into the new table a few slots at a time
+// on later updates instead of rehashing everything at once.
+template <typename Key, typename Value, typename Hash = flat_hash<Key>>
+class flat_map {
+ public:
+  flat_map() = default;
+
+  size_t size() const { return table_.size + old_.size; }
+  bool empty() const { return size() == 0; }
+
+  void clear() {
+    table_ = {};
+    old_ = {};
+    migrated_ = 0;
+  }
+
+  Value* find(const Key& key) {
+    uint64_t hash = Hash{}(key);
+    if (slot* s = table_.find(key, hash)) {
+      return &s->value;
+    }
+    if (slot* s = old_.find(key, hash)) {
+      return &s->value;
+    }
+    return nullptr;
+  }
+
+  const Value* find(const Key& key) const {
+    return const_cast<flat_map*>(this)->find(key);
+  }
+
+  Value& operator[](const Key& key) {
+    uint64_t hash = Hash{}(key);
+    if (slot* s = table_.find(key, hash)) {
+      return s->value;
+    }
+
+    // entries not migrated yet move over on first access
+    Value value{};
+    if (slot* s = old_.find(key, hash)) {
+      value = std::move(s->value);
+      old_.erase(s);
+    }
+
+    migrate(kMigrateSlots);
+    if (table_.full()) {
+      grow();
+    }
+    return table_.insert(key, hash, std::move(value))->value;
+  }
+
+  bool erase(const Key& key) {
+    uint64_t hash = Hash{}(key);
+    if (slot* s = table_.find(key, hash)) {
+      table_.erase(s);
+      return true;
+    }
+    if (slot* s = old_.find(key, hash)) {
+      old_.erase(s);
+      return true;
+    }
+    return false;
+  }
+
+  // Calls |fn(key, value)| for every entry.
+  template <typename F>
+  void for_each(F&& fn) const {
+    table_.for_each(fn);
+    old_.for_each(fn);
+  }
+
+  template <typename F>
+  void for_each(F&& fn) {
+    table_.for_each(fn);
+    old_.for_each(fn);
+  }
+
+  // Removes entries for which |fn(key, value)| returns true.
+  template <typename F>
+  void erase_if(F&& fn) {
+    table_.erase_if(fn);
+    old_.erase_if(fn);
+  }
+
+ private:
+  static constexpr int kGroupSize = 16;
+  static constexpr size_t kMigrateSlots = 64;
+  static constexpr int8_t kEmpty = -128;   // 0b10000000
+  static constexpr int8_t kDeleted = -2;   // 0b11111110
+
+  struct slot {
+    Key key;
+    Value value;
+  };
+
+  static uint32_t match(const int8_t* group, int8_t h2) {
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(ctrl, _mm_set1_epi8(h2)));
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < kGroupSize; ++i) {
+      mask |= (uint32_t)(group[i] == h2) << i;
+    }
+    return mask;
+#endif
+  }
+
+  // full slots have the top bit clear
+  static uint32_t match_free(const int8_t* group) {
+#if defined(__SSE2__) || defined(_M_X64)
+    __m128i ctrl = _mm_loadu_si128((const __m128i*)group);
+    return (uint32_t)_mm_movemask_epi8(ctrl);
+#else
+    uint32_t mask = 0;
+    for (int i = 0; i < kGroupSize; ++i) {
+      mask |= (uint32_t)(group[i] < 0) << i;
+    }
+    return mask;
+#endif
+  }
+
+  struct table {
+    std::vector<int8_t> ctrl;
+    std::vector<slot> slots;
+    size_t size = 0;
+    size_t deleted = 0;
+
+    size_t capacity() const { return slots.size(); }
+    size_t groups() const { return capacity() / kGroupSize; }
+
+    // keeps at most 7/8 of the slots in use so probes stay short
+    bool full() const {
+      return (size + deleted + 1) * 8 > capacity() * 7;
+    }
+
+    void allocate(size_t capacity) {
+      ctrl.assign(capacity, kEmpty);
+      slots.assign(capacity, slot{});
+      size = 0;
+      deleted = 0;
+    }
+
+    slot* find(const Key& key, uint64_t hash) {
+      if (size == 0) {
+        return nullptr;
+      }
+      int8_t h2 = (int8_t)(hash & 0x7f);
+      size_t group_mask = groups() - 1;
+      size_t g = (hash >> 7) & group_mask;
+      for (size_t probe = 0; probe < groups(); ++probe) {
+        const int8_t* group = &ctrl[g * kGroupSize];
+        for (uint32_t m = match(group, h2); m; m &= m - 1) {
+          size_t i = g * kGroupSize + std::countr_zero(m);
+          if (slots[i].key == key) {
+            return &slots[i];
+          }
+        }
+        if (match(group, kEmpty)) {
+          return nullptr;
+        }
+        g = (g + 1) & group_mask;
+      }
+      return nullptr;
+    }
+
+    // |key| must not be in the table yet.
+    slot* insert(const Key& key, uint64_t hash, Value&& value) {
+      size_t group_mask = groups() - 1;
+      size_t g = (hash >> 7) & group_mask;
+      while (true) {
+        int8_t* group = &ctrl[g * kGroupSize];
+        if (uint32_t m = match_free(group)) {
+          size_t i = g * kGroupSize + std::countr_zero(m);
+          if (ctrl[i] == kDeleted) {
+            deleted--;
+          }
+          ctrl[i] = (int8_t)(hash & 0x7f);
+          slots[i] = slot{key, std::move(value)};
+          size++;
+          return &slots[i];
+        }
+        g = (g + 1) & group_mask;
+      }
+    }
+
+    void erase(slot* s) {
+      size_t i = s - slots.data();
+      ctrl[i] = kDeleted;
+      slots[i] = slot{};
+      size--;
+      deleted++;
+    }
+
+    template <typename F>
+    void for_each(F& fn) const {
+      for (size_t i = 0; i < capacity(); ++i) {
+        if (ctrl[i] >= 0) {
+          fn(slots[i].key, slots[i].value);
+        }
+      }
+    }
+
+    template <typename F>
+    void for_each(F& fn) {
+      for (size_t i = 0; i < capacity(); ++i) {
+        if (ctrl[i] >= 0) {
+          fn(slots[i].key, slots[i].value);
+        }
+      }
+    }
+
+    template <typename F>
+    void erase_if(F& fn) {
+      for (size_t i = 0; i < capacity(); ++i) {
+        if (ctrl[i] >= 0 && fn(slots[i].key, slots[i].value)) {
+          erase(&slots[i]);
+        }
+      }
+    }
+  };
+
+  void grow() {
+    // the previous resize has to be finished first
+    migrate(old_.capacity());
+
+    size_t capacity = table_.capacity() ? table_.capacity() * 2 : kGroupSize;
+    if (table_.size * 2 < table_.capacity()) {
+      capacity = table_.capacity();  // mostly tombstones, rehash in place
+    }
+    old_ = std::move(table_);
+    table_ = {};
+    table_.allocate(capacity);
+    migrated_ = 0;
+  }
+
+  // Moves up to |count| slots of the old table into the current one.
+  void migrate(size_t count) {
+    if (old_.capacity() == 0) {
+      return;
+    }
+    size_t end = std::min(migrated_ + count, old_.capacity());
+    for (; migrated_ < end; ++migrated_) {
+      if (old_.ctrl[migrated_] >= 0) {
+        slot& s = old_.slots[migrated_];
+        table_.insert(s.key, Hash{}(s.key), std::move(s.value));
+        old_.ctrl[migrated_] = kDeleted;
+        old_.size--;
+      }
+    }
+    if (migrated_ == old_.capacity()) {
+      old_ = {};
+      migrated_ = 0;
+    }
+  }
+
+  table table_;
+  table old_;
+  size_t migrated_ = 0;
+};
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "flat_map.h"
+
+// Set of keys for deduplicating the frames of one sample. Slots are stamped
+// with the generation that filled them, so clear() only bumps the
+// generation and the storage is reused from sample to sample.
+class generation_set {
+ public:
+  generation_set() { resize(256); }
+
+  void clear() {
+    size_ = 0;
+    if (++generation_ == 0) {
+      std::ranges::fill(stamps_, 0);
+      generation_ = 1;
+    }
+  }
+
+  bool contains(uint64_t key) const {
+    size_t mask = keys_.size() - 1;
+    for (size_t i = flat_hash<uint64_t>{}(key) & mask;; i = (i + 1) & mask) {
+      if (stamps_[i] != generation_) {
+        return false;
+      }
+      if (keys_[i] == key) {
+        return true;
+      }
+    }
+  }
+
+  // Returns false if |key| was already inserted since the last clear().
+  bool insert(uint64_t key) {
+    if ((size_ + 1) * 2 > keys_.size()) {
+      resize(keys_.size() * 2);
+    }
+    size_t mask = keys_.size() - 1;
+    for (size_t i = flat_hash<uint64_t>{}(key) & mask;; i = (i + 1) & mask) {
+      if (stamps_[i] != generation_) {
+        stamps_[i] = generation_;
+        keys_[i] = key;
+        size_++;
+        return true;
+      }
+      if (keys_[i] == key) {
+        return false;
+      }
+    }
+  }
+
+ private:
+  void resize(size_t capacity) {
+    std::vector<uint64_t> keys;
+    for (size_t i = 0; i < keys_.size(); ++i) {
+      if (stamps_[i] == generation_) {
+        keys.push_back(keys_[i]);
+      }
+    }
+    keys_.assign(capacity, 0);
+    stamps_.assign(capacity, 0);
+    size_ = 0;
+    for (uint64_t key : keys) {
+      insert(key);
+    }
+  }
+
+  std::vector<uint64_t> keys_;
+  std::vector<uint32_t> stamps_;
+  uint32_t generation_ = 1;
+  size_t size_ = 0;
+};
@@ -0,0 +1,71 @@
+#include "heavy_hitters.h"
+
+#include <algorithm>
+#include <utility>
+
+heavy_hitters::heavy_hitters(size_t capacity)
+    : capacity_(std::max<size_t>(capacity, 1)) {}
+
+void heavy_hitters::add(uint64_t key, uint64_t count) {
+  // 0 means the key is not tracked
+  uint32_t& id = index_[key];
+  if (id) {
+    entries_[id - 1].count += count;
+    sift_down(entries_[id - 1].heap);
+    return;
+  }
+
+  if (entries_.size() < capacity_) {
+    id = (uint32_t)entries_.size() + 1;
+    entries_.push_back(entry{
+        .key = key,
+        .count = count,
+        .error = 0,
+        .heap = (uint32_t)heap_.size(),
+    });
+    heap_.push_back(id - 1);
+    // sift up
+    uint32_t position = entries_.back().heap;
+    while (position > 0) {
+      uint32_t parent = (position - 1) / 2;
+      if (entries_[heap_[parent]].count <= entries_[heap_[position]].count) {
+        break;
+      }
+      std::swap(heap_[parent], heap_[position]);
+      entries_[heap_[parent]].heap = parent;
+      entries_[heap_[position]].heap = position;
+      position = parent;
+    }
+    return;
+  }
+
+  // take over the smallest entry
+  uint32_t victim = heap_[0];
+  entry& e = entries_[victim];
+  id = victim + 1;
+  index_.erase(e.key);
+  e.key = key;
+  e.error = e.count;
+  e.count += count;
+  sift_down(0);
+}
+
+void heavy_hitters::sift_down(uint32_t position) {
+  uint32_t size = (uint32_t)heap_.size();
+  while (true) {
+    uint32_t smallest = position;
+    for (uint32_t child : {2 * position + 1, 2 * position + 2}) {
+      if (child < size &&
+          entries_[heap_[child]].count < entries_[heap_[smallest]].count) {
+        smallest = child;
+      }
+    }
+    if (smallest == position) {
+      break;
+    }
+    std::swap(heap_[smallest], heap_[position]);
+    entries_[heap_[smallest]].heap = smallest;
+    entries_[heap_[position]].heap = position;
+    position = smallest;
+  }
+}
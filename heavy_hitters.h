@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "flat_map.h"
+
+// Space-Saving summary of the most frequent keys of a stream, in at most
+// |capacity| entries. When a new key arrives and the summary is full it
+// replaces the key with the smallest count and inherits that count as its
+// error, so every reported count overestimates the true one by at most
+// |error|, and a key that is not reported occurred at most min_count() times.
+class heavy_hitters {
+ public:
+  explicit heavy_hitters(size_t capacity);
+
+  void add(uint64_t key, uint64_t count = 1);
+
+  size_t size() const { return entries_.size(); }
+  uint64_t min_count() const {
+    return entries_.size() < capacity_ ? 0 : entries_[heap_[0]].count;
+  }
+
+  // Calls |fn(key, count, error)| for every tracked key.
+  template <typename F>
+  void for_each(F&& fn) const {
+    for (const auto& e : entries_) {
+      fn(e.key, e.count, e.error);
+    }
+  }
+
+ private:
+  struct entry {
+    uint64_t key;
+    uint64_t count;
+    uint64_t error;
+    uint32_t heap;  // position in heap_
+  };
+
+  void sift_down(uint32_t position);
+
+  size_t capacity_;
+  std::vector<entry> entries_;
+  std::vector<uint32_t> heap_;           // entry ids, smallest count first
+  flat_map<uint64_t, uint32_t> index_;   // key -> entry id + 1
+};
@@ -0,0 +1,539 @@
+#include "inline_table.h"
+
+#include <algorithm>
+
+namespace {
+
+constexpr uint64_t kTagCompileUnit = 0x11;
+constexpr uint64_t kTagPartialUnit = 0x3c;
+constexpr uint64_t kTagInlinedSubroutine = 0x1d;
+
+constexpr uint64_t kAtName = 0x03;
+constexpr uint64_t kAtStmtList = 0x10;
+constexpr uint64_t kAtLowPc = 0x11;
+constexpr uint64_t kAtHighPc = 0x12;
+constexpr uint64_t kAtAbstractOrigin = 0x31;
+constexpr uint64_t kAtSpecification = 0x47;
+constexpr uint64_t kAtRanges = 0x55;
+constexpr uint64_t kAtCallFile = 0x58;
+constexpr uint64_t kAtCallLine = 0x59;
+constexpr uint64_t kAtLinkageName = 0x6e;
+constexpr uint64_t kAtStrOffsetsBase = 0x72;
+constexpr uint64_t kAtAddrBase = 0x73;
+constexpr uint64_t kAtRnglistsBase = 0x74;
+constexpr uint64_t kAtMipsLinkageName = 0x2007;
+
+constexpr uint8_t kUtCompile = 1;
+constexpr uint8_t kUtPartial = 3;
+
+constexpr uint8_t kRleEndOfList = 0;
+constexpr uint8_t kRleBaseAddressx = 1;
+constexpr uint8_t kRleStartxEndx = 2;
+constexpr uint8_t kRleStartxLength = 3;
+constexpr uint8_t kRleOffsetPair = 4;
+constexpr uint8_t kRleBaseAddress = 5;
+constexpr uint8_t kRleStartEnd = 6;
+constexpr uint8_t kRleStartLength = 7;
+
+// abstract origins followed for the name of a function
+constexpr int kMaxOriginDepth = 4;
+
+bool is_strx(uint64_t form) {
+  return form == dwarf::kFormStrx || form == dwarf::kFormGnuStrIndex ||
+         (form >= dwarf::kFormStrx1 && form <= dwarf::kFormStrx4);
+}
+
+bool is_addrx(uint64_t form) {
+  return form == dwarf::kFormAddrx || form == dwarf::kFormGnuAddrIndex ||
+         (form >= dwarf::kFormAddrx1 && form <= dwarf::kFormAddrx4);
+}
+
+bool is_ref(uint64_t form) {
+  return form >= dwarf::kFormRef1 && form <= dwarf::kFormRefUdata;
+}
+
+// the attributes of an entry that the table is built from
+struct entry {
+  uint64_t tag = 0;
+  bool children = false;
+  dwarf::value name{};
+  dwarf::value linkage_name{};
+  dwarf::value low_pc{};
+  dwarf::value high_pc{};
+  dwarf::value ranges{};
+  uint64_t origin = 0;  // offset in .debug_info, 0 if none
+  uint64_t call_file = 0;
+  uint64_t call_line = 0;
+  dwarf::value stmt_list{};
+  dwarf::value str_offsets_base{};
+  dwarf::value addr_base{};
+  dwarf::value rnglists_base{};
+};
+
+// Reads the entry at |r|. Returns false at the end of the unit or on
+// malformed data; a null entry has tag 0.
+template <typename Abbrevs>
+bool read_entry(dwarf::reader& r,
+                uint64_t unit_offset,
+                const dwarf::unit_format& format,
+                const dwarf::sections& sections,
+                const Abbrevs& abbrevs,
+                entry* e) {
+  *e = entry{};
+  uint64_t code = r.uleb();
+  if (!r.ok) {
+    return false;
+  }
+  if (code == 0) {
+    return true;
+  }
+  if (code >= abbrevs.size() || abbrevs[code].tag == 0) {
+    return false;
+  }
+  const auto& a = abbrevs[code];
+  e->tag = a.tag;
+  e->children = a.children;
+  for (const auto& attribute : a.attributes) {
+    dwarf::value v;
+    if (!dwarf::read_value(r, attribute.form, attribute.implicit_const, format,
+                           sections, &v)) {
+      return false;
+    }
+    switch (attribute.name) {
+      case kAtName: e->name = v; break;
+      case kAtLinkageName:
+      case kAtMipsLinkageName: e->linkage_name = v; break;
+      case kAtLowPc: e->low_pc = v; break;
+      case kAtHighPc: e->high_pc = v; break;
+      case kAtRanges: e->ranges = v; break;
+      case kAtCallFile: e->call_file = v.data; break;
+      case kAtCallLine: e->call_line = v.data; break;
+      case kAtStmtList: e->stmt_list = v; break;
+      case kAtStrOffsetsBase: e->str_offsets_base = v; break;
+      case kAtAddrBase: e->addr_base = v; break;
+      case kAtRnglistsBase: e->rnglists_base = v; break;
+      case kAtAbstractOrigin:
+      case kAtSpecification:
+        if (is_ref(v.form)) {
+          e->origin = unit_offset + v.data;
+        } else if (v.form == dwarf::kFormRefAddr) {
+          e->origin = v.data;
+        }
+        break;
+    }
+  }
+  return r.ok;
+}
+
+}  // namespace
+
+void inline_table::build(const dwarf::sections& sections) {
+  sections_ = &sections;
+
+  // every unit is read up to its first child before any is decoded, as
+  // entries may refer to other units
+  dwarf::for_each_unit(sections.info, [&](std::span<const uint8_t> data) {
+    unit u{};
+    if (read_unit(data, &u)) {
+      units_.push_back(std::move(u));
+    }
+  });
+  for (const auto& u : units_) {
+    decode_unit(u);
+  }
+
+  // outer ranges before the ranges they contain
+  std::vector<size_t> order(decoded_starts_.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+    if (decoded_starts_[a] != decoded_starts_[b]) {
+      return decoded_starts_[a] < decoded_starts_[b];
+    }
+    return decoded_ends_[a] > decoded_ends_[b];
+  });
+  std::vector<uint64_t> starts, ends;
+  std::vector<range> ranges;
+  std::vector<uint32_t> open;
+  for (size_t i : order) {
+    while (!open.empty() && ends[open.back()] <= decoded_starts_[i]) {
+      open.pop_back();
+    }
+    // ranges that overlap without nesting are not a parent
+    uint32_t parent = kNone;
+    for (auto it = open.rbegin(); it != open.rend(); ++it) {
+      if (ends[*it] >= decoded_ends_[i]) {
+        parent = *it;
+        break;
+      }
+    }
+    open.push_back((uint32_t)starts.size());
+    starts.push_back(decoded_starts_[i]);
+    ends.push_back(decoded_ends_[i]);
+    ranges.push_back(range{decoded_ranges_[i].call, parent});
+  }
+  decoded_starts_ = std::move(starts);
+  decoded_ends_ = std::move(ends);
+  decoded_ranges_ = std::move(ranges);
+  starts_ = decoded_starts_;
+  ends_ = decoded_ends_;
+  ranges_ = decoded_ranges_;
+  calls_ = decoded_calls_;
+  names_ = decoded_names_.names();
+
+  sections_ = nullptr;
+  units_ = {};
+  abbrevs_ = {};
+  function_names_ = {};
+}
+
+void inline_table::find(uint64_t address, std::vector<frame>* frames) const {
+  size_t i = std::upper_bound(starts_.begin(), starts_.end(), address) -
+             starts_.begin();
+  if (i == 0) {
+    return;
+  }
+  for (uint32_t r = (uint32_t)(i - 1); r != kNone; r = ranges_[r].parent) {
+    if (address >= ends_[r]) {
+      continue;
+    }
+    const call& c = calls_[ranges_[r].call];
+    frames->push_back(frame{
+        .function_name = names_[c.function_name],
+        .call_file = names_[c.call_file],
+        .call_line = c.call_line,
+    });
+  }
+}
+
+void inline_table::save(symbol_cache::writer* cache) const {
+  cache->add<uint64_t>(symbol_cache::kInlineStarts, starts_);
+  cache->add<uint64_t>(symbol_cache::kInlineEnds, ends_);
+  cache->add<range>(symbol_cache::kInlineRanges, ranges_);
+  cache->add<call>(symbol_cache::kInlineCalls, calls_);
+  cache->add_strings(symbol_cache::kInlineNames, names_);
+}
+
+// Parents must come before the ranges they contain, so find() cannot loop.
+bool inline_table::load(const symbol_cache& cache) {
+  auto starts = cache.array<uint64_t>(symbol_cache::kInlineStarts);
+  auto ends = cache.array<uint64_t>(symbol_cache::kInlineEnds);
+  auto ranges = cache.array<range>(symbol_cache::kInlineRanges);
+  auto calls = cache.array<call>(symbol_cache::kInlineCalls);
+  auto names = cache.strings(symbol_cache::kInlineNames);
+  if (!cache.contains(symbol_cache::kInlineRanges) ||
+      starts.size() != ranges.size() || ends.size() != ranges.size()) {
+    return false;
+  }
+  if (names.empty() || !names[0].empty()) {
+    return false;  // id 0 is the empty string
+  }
+  for (size_t i = 0; i < ranges.size(); ++i) {
+    if (ranges[i].call >= calls.size() ||
+        (ranges[i].parent != kNone && ranges[i].parent >= i)) {
+      return false;
+    }
+  }
+  for (const call& c : calls) {
+    if (c.function_name >= names.size() || c.call_file >= names.size()) {
+      return false;
+    }
+  }
+  starts_ = starts;
+  ends_ = ends;
+  ranges_ = ranges;
+  calls_ = calls;
+  cached_names_ = std::move(names);
+  names_ = cached_names_;
+  return true;
+}
+
+const std::vector<inline_table::abbrev>& inline_table::abbrevs(
+    uint64_t offset) {
+  auto [it, inserted] = abbrevs_.try_emplace(offset);
+  if (!inserted || offset >= sections_->abbrev.size()) {
+    return it->second;
+  }
+  // indexed by code, codes are mostly dense
+  auto& table = it->second;
+  dwarf::reader r(sections_->abbrev.subspan(offset));
+  while (r.ok) {
+    uint64_t code = r.uleb();
+    if (code == 0 || code > (1 << 20)) {
+      break;
+    }
+    abbrev a{.tag = r.uleb(), .children = r.u8() != 0, .attributes = {}};
+    while (r.ok) {
+      uint64_t name = r.uleb();
+      uint64_t form = r.uleb();
+      if (name == 0 && form == 0) {
+        break;
+      }
+      int64_t implicit_const =
+          form == dwarf::kFormImplicitConst ? r.sleb() : 0;
+      a.attributes.push_back({name, form, implicit_const});
+    }
+    if (code >= table.size()) {
+      table.resize(code + 1);
+    }
+    table[code] = std::move(a);
+  }
+  return table;
+}
+
+const inline_table::unit* inline_table::find_unit(uint64_t offset) const {
+  auto it = std::upper_bound(
+      units_.begin(), units_.end(), offset,
+      [](uint64_t offset, const unit& u) { return offset < u.offset; });
+  if (it == units_.begin()) {
+    return nullptr;
+  }
+  --it;
+  return offset < it->offset + it->data.size() ? &*it : nullptr;
+}
+
+// Reads the unit header and the unit entry, which holds the bases of the
+// indexed forms.
+bool inline_table::read_unit(std::span<const uint8_t> data, unit* u) {
+  dwarf::reader r(data);
+  u->offset = data.data() - sections_->info.data();
+  u->data = data;
+  u->format.dwarf64 = r.u32() == 0xffffffff;
+  if (u->format.dwarf64) {
+    r.u64();
+  }
+  u->format.version = r.u16();
+  uint8_t unit_type = kUtCompile;
+  if (u->format.version >= 5) {
+    unit_type = r.u8();
+    u->format.address_size = r.u8();
+    u->abbrev_offset = u->format.dwarf64 ? r.u64() : r.u32();
+  } else {
+    u->abbrev_offset = u->format.dwarf64 ? r.u64() : r.u32();
+    u->format.address_size = r.u8();
+  }
+  if (!r.ok || u->format.version < 2 || u->format.version > 5 ||
+      (unit_type != kUtCompile && unit_type != kUtPartial)) {
+    return false;
+  }
+
+  entry e;
+  if (!read_entry(r, u->offset, u->format, *sections_,
+                  abbrevs(u->abbrev_offset), &e) ||
+      (e.tag != kTagCompileUnit && e.tag != kTagPartialUnit)) {
+    return false;
+  }
+  u->children = r.p - data.data();
+  if (!e.children) {
+    u->children = data.size();
+  }
+  u->str_offsets_base = e.str_offsets_base.data;
+  u->addr_base = e.addr_base.data;
+  u->rnglists_base = e.rnglists_base.data;
+  u->low_pc = e.low_pc.form ? address(*u, e.low_pc) : 0;
+
+  // call_file indexes the file table of the unit's line program
+  dwarf::line_header header;
+  if (e.stmt_list.form &&
+      dwarf::read_line_header(dwarf::unit_at(sections_->line, e.stmt_list.data),
+                              *sections_, &header)) {
+    for (const auto& path : header.files) {
+      u->files.push_back(decoded_names_.intern(path));
+    }
+  }
+  return true;
+}
+
+std::string_view inline_table::string(const unit& u,
+                                      const dwarf::value& v) const {
+  if (!is_strx(v.form)) {
+    return v.str;
+  }
+  size_t offset_size = u.format.dwarf64 ? 8 : 4;
+  dwarf::reader r(sections_->str_offsets);
+  r.skip(u.str_offsets_base + v.data * offset_size);
+  return dwarf::string_at(sections_->str, r.fixed(offset_size));
+}
+
+uint64_t inline_table::address(const unit& u, const dwarf::value& v) const {
+  if (!is_addrx(v.form)) {
+    return v.data;
+  }
+  dwarf::reader r(sections_->addr);
+  r.skip(u.addr_base + v.data * u.format.address_size);
+  return r.fixed(u.format.address_size);
+}
+
+void inline_table::decode_unit(const unit& u) {
+  const auto& table = abbrevs(u.abbrev_offset);
+  const dwarf::sections& sections = *sections_;
+  size_t offset_size = u.format.dwarf64 ? 8 : 4;
+
+  // ranges of an entry, from low/high pc or a range list
+  std::vector<std::pair<uint64_t, uint64_t>> pcs;
+  auto read_ranges = [&](const entry& e) {
+    pcs.clear();
+    if (e.low_pc.form && e.high_pc.form) {
+      uint64_t low = address(u, e.low_pc);
+      // high pc is an offset from low pc unless it is an address form
+      bool absolute =
+          e.high_pc.form == dwarf::kFormAddr || is_addrx(e.high_pc.form);
+      pcs.emplace_back(low,
+                       absolute ? address(u, e.high_pc) : low + e.high_pc.data);
+      return;
+    }
+    if (!e.ranges.form) {
+      return;
+    }
+    uint64_t base = u.low_pc;
+    if (u.format.version < 5) {
+      dwarf::reader r(sections.ranges);
+      r.skip(e.ranges.data);
+      uint64_t max = u.format.address_size == 4 ? 0xffffffff : ~0ull;
+      while (r.ok && !r.done()) {
+        uint64_t start = r.fixed(u.format.address_size);
+        uint64_t end = r.fixed(u.format.address_size);
+        if (start == 0 && end == 0) {
+          break;
+        }
+        if (start == max) {
+          base = end;
+          continue;
+        }
+        pcs.emplace_back(base + start, base + end);
+      }
+      return;
+    }
+
+    uint64_t list = e.ranges.data;
+    if (e.ranges.form == dwarf::kFormRnglistx) {
+      dwarf::reader r(sections.rnglists);
+      r.skip(u.rnglists_base + e.ranges.data * offset_size);
+      list = u.rnglists_base + r.fixed(offset_size);
+    }
+    dwarf::reader r(sections.rnglists);
+    r.skip(list);
+    auto indexed = [&](uint64_t index) {
+      return address(u, dwarf::value{
+          .form = dwarf::kFormAddrx, .data = index, .str = {}});
+    };
+    while (r.ok && !r.done()) {
+      uint8_t kind = r.u8();
+      if (kind == kRleEndOfList) {
+        break;
+      }
+      switch (kind) {
+        case kRleBaseAddressx:
+          base = indexed(r.uleb());
+          break;
+        case kRleStartxEndx: {
+          uint64_t start = indexed(r.uleb());
+          pcs.emplace_back(start, indexed(r.uleb()));
+          break;
+        }
+        case kRleStartxLength: {
+          uint64_t start = indexed(r.uleb());
+          pcs.emplace_back(start, start + r.uleb());
+          break;
+        }
+        case kRleOffsetPair: {
+          uint64_t start = base + r.uleb();
+          pcs.emplace_back(start, base + r.uleb());
+          break;
+        }
+        case kRleBaseAddress:
+          base = r.fixed(u.format.address_size);
+          break;
+        case kRleStartEnd: {
+          uint64_t start = r.fixed(u.format.address_size);
+          pcs.emplace_back(start, r.fixed(u.format.address_size));
+          break;
+        }
+        case kRleStartLength: {
+          uint64_t start = r.fixed(u.format.address_size);
+          pcs.emplace_back(start, start + r.uleb());
+          break;
+        }
+        default:
+          return;
+      }
+    }
+  };
+
+  dwarf::reader r(u.data);
+  r.skip(u.children);
+  entry e;
+  int depth = 1;
+  while (depth > 0 &&
+         read_entry(r, u.offset, u.format, sections, table, &e)) {
+    if (e.tag == 0) {
+      depth--;
+      continue;
+    }
+    if (e.children) {
+      depth++;
+    }
+    if (e.tag != kTagInlinedSubroutine) {
+      continue;
+    }
+    read_ranges(e);
+    uint32_t id = (uint32_t)decoded_calls_.size();
+    bool added = false;
+    for (auto [start, end] : pcs) {
+      // address 0 belongs to code the linker discarded
+      if (start == 0 || start >= end) {
+        continue;
+      }
+      decoded_starts_.push_back(start);
+      decoded_ends_.push_back(end);
+      decoded_ranges_.push_back(range{id, kNone});
+      added = true;
+    }
+    if (!added) {
+      continue;
+    }
+    uint32_t name = 0;
+    if (e.linkage_name.form) {
+      name = decoded_names_.intern(string(u, e.linkage_name));
+    } else if (e.origin) {
+      name = function_name(e.origin, 0);
+    } else if (e.name.form) {
+      name = decoded_names_.intern(string(u, e.name));
+    }
+    decoded_calls_.push_back(call{
+        .function_name = name,
+        .call_file = e.call_file < u.files.size() ? u.files[e.call_file] : 0,
+        .call_line = (uint32_t)e.call_line,
+    });
+  }
+}
+
+// Name of the function entry at |offset|, following its abstract origin or
+// specification for the linkage name, which is qualified once demangled.
+uint32_t inline_table::function_name(uint64_t offset, int depth) {
+  if (auto it = function_names_.find(offset); it != function_names_.end()) {
+    return it->second;
+  }
+  uint32_t name = 0;
+  entry e;
+  const unit* u = find_unit(offset);
+  if (u) {
+    dwarf::reader r(u->data);
+    r.skip(offset - u->offset);
+    if (!read_entry(r, u->offset, u->format, *sections_,
+                    abbrevs(u->abbrev_offset), &e)) {
+      u = nullptr;
+    }
+  }
+  if (u && e.linkage_name.form) {
+    name = decoded_names_.intern(string(*u, e.linkage_name));
+  } else if (u && e.origin && depth < kMaxOriginDepth) {
+    name = function_name(e.origin, depth + 1);
+  }
+  if (u && name == 0 && e.name.form) {
+    name = decoded_names_.intern(string(*u, e.name));
+  }
+  function_names_[offset] = name;
+  return name;
+}
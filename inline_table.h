@@ -0,0 +1,102 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarf.h"
+#include "symbol_cache.h"
+#include "string_table.h"
+
+// Calls the compiler inlined into each address of one module, decoded from
+// the DW_TAG_inlined_subroutine entries of .debug_info. Ranges of inlined
+// calls nest; they are sorted by start and each links to the innermost
+// range around it, so a lookup is one binary search and a walk outwards.
+class inline_table {
+ public:
+  void build(const dwarf::sections& sections);
+
+  // Stores the ranges and calls in |cache|, or serves them from it, which
+  // must then outlive the table. load() returns false if |cache| has no
+  // table or an inconsistent one.
+  void save(symbol_cache::writer* cache) const;
+  bool load(const symbol_cache& cache);
+
+  struct frame {
+    std::string_view function_name;  // linkage name where there is one
+    std::string_view call_file;      // where it was inlined into its caller
+    uint32_t call_line;
+  };
+  // Appends the inlined calls covering link-time address |address|,
+  // innermost first.
+  void find(uint64_t address, std::vector<frame>* frames) const;
+
+  size_t size() const { return calls_.size(); }
+
+ private:
+  static constexpr uint32_t kNone = ~0u;
+
+  struct call {
+    uint32_t function_name;
+    uint32_t call_file;
+    uint32_t call_line;
+  };
+  struct range {
+    uint32_t call;
+    uint32_t parent;  // enclosing range, kNone if outermost
+  };
+  struct abbrev {
+    uint64_t tag;
+    bool children;
+    struct attribute {
+      uint64_t name;
+      uint64_t form;
+      int64_t implicit_const;
+    };
+    std::vector<attribute> attributes;
+  };
+  // a compile unit of .debug_info, with what its entries refer to
+  struct unit {
+    uint64_t offset;
+    std::span<const uint8_t> data;
+    size_t children;  // offset of the first entry below the unit entry
+    dwarf::unit_format format;
+    uint64_t abbrev_offset;
+    uint64_t str_offsets_base;
+    uint64_t addr_base;
+    uint64_t rnglists_base;
+    uint64_t low_pc;
+    std::vector<uint32_t> files;  // ids in names_ by file index
+  };
+
+  const std::vector<abbrev>& abbrevs(uint64_t offset);
+  bool read_unit(std::span<const uint8_t> data, unit* u);
+  void decode_unit(const unit& u);
+  std::string_view string(const unit& u, const dwarf::value& v) const;
+  uint64_t address(const unit& u, const dwarf::value& v) const;
+  uint32_t function_name(uint64_t offset, int depth);
+  const unit* find_unit(uint64_t offset) const;
+
+  // only used while building
+  const dwarf::sections* sections_ = nullptr;
+  std::vector<unit> units_;
+  std::unordered_map<uint64_t, std::vector<abbrev>> abbrevs_;
+  std::unordered_map<uint64_t, uint32_t> function_names_;  // by DIE offset
+
+  // sorted by start, kept apart from the rest for the binary search; in
+  // the cache the table was loaded from or in the decoded arrays below
+  std::span<const uint64_t> starts_;
+  std::span<const uint64_t> ends_;
+  std::span<const range> ranges_;
+  std::span<const call> calls_;
+  std::span<const std::string_view> names_;  // functions and files by id
+
+  std::vector<uint64_t> decoded_starts_;
+  std::vector<uint64_t> decoded_ends_;
+  std::vector<range> decoded_ranges_;
+  std::vector<call> decoded_calls_;
+  string_table decoded_names_;
+  std::vector<std::string_view> cached_names_;
+};
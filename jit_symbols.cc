@@ -0,0 +1,327 @@
+#if defined(__linux__)
+
+#include "jit_symbols.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+
+namespace {
+
+// jitdump format, as written by the JIT agents of perf
+constexpr uint32_t kJitdumpMagic = 0x4a695444;  // "JiTD"
+constexpr uint32_t kJitCodeLoad = 0;
+constexpr uint32_t kJitCodeMove = 1;
+
+struct jitdump_header {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t total_size;
+  uint32_t elf_mach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+struct record_header {
+  uint32_t id;
+  uint32_t total_size;
+  uint64_t timestamp;
+};
+// followed by the terminated name and the code
+struct code_load {
+  record_header header;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+};
+struct code_move {
+  record_header header;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t old_code_addr;
+  uint64_t new_code_addr;
+  uint64_t code_size;
+  uint64_t code_index;
+};
+
+constexpr size_t kReadSize = 64 * 1024;
+
+}  // namespace
+
+jit_symbols::~jit_symbols() {
+  detach();
+}
+
+void jit_symbols::attach(uint32_t pid, const std::string& root) {
+  detach();
+  root_ = root;
+  map_path_ = "/tmp/perf-" + std::to_string(pid) + ".map";
+  update(0);  // nothing was looked up yet
+}
+
+void jit_symbols::detach() {
+  for (auto& s : sources_) {
+    close_source(s);
+  }
+  sources_.clear();
+  starts_.clear();
+  ranges_.clear();
+  added_.clear();
+  loaded_.clear();
+  code_names_.clear();
+  names_.clear();
+  map_path_.clear();
+}
+
+void jit_symbols::add_dump(const std::string& path) {
+  for (const auto& s : sources_) {
+    if (s.path == path) {
+      return;
+    }
+  }
+  open_source(path, true);
+}
+
+// Files are opened below the root of the target first, so targets in
+// another mount namespace resolve too.
+bool jit_symbols::open_source(const std::string& path, bool dump) {
+  int fd = ::open((root_ + path).c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  }
+  if (fd < 0) {
+    return false;
+  }
+  sources_.push_back(source{
+      .path = path,
+      .fd = fd,
+      .dump = dump,
+      .header_read = false,
+      .offset = 0,
+      .pending = {},
+  });
+  return true;
+}
+
+// Sources that cannot be read on are kept closed, so they are not opened
+// again.
+void jit_symbols::close_source(source& s) {
+  if (s.fd >= 0) {
+    ::close(s.fd);
+  }
+  s.fd = -1;
+  s.pending.clear();
+}
+
+void jit_symbols::update(uint32_t generation) {
+  // the perf map is created when the JIT emits its first function
+  if (!map_path_.empty() && open_source(map_path_, false)) {
+    map_path_.clear();
+  }
+
+  for (auto& s : sources_) {
+    if (s.fd < 0) {
+      continue;
+    }
+    char buffer[kReadSize];
+    bool appended = false;
+    while (true) {
+      ssize_t n = ::pread(s.fd, buffer, sizeof(buffer), (off_t)s.offset);
+      if (n <= 0) {
+        break;
+      }
+      s.pending.append(buffer, (size_t)n);
+      s.offset += (uint64_t)n;
+      appended = true;
+    }
+    if (!appended) {
+      continue;
+    }
+    if (s.dump) {
+      read_dump(s);
+    } else {
+      read_map(s);
+    }
+  }
+  merge(generation);
+}
+
+std::vector<jit_symbols::loaded_range> jit_symbols::take_loaded() {
+  std::vector<loaded_range> loaded;
+  loaded.swap(loaded_);
+  return loaded;
+}
+
+bool jit_symbols::find(uint64_t address, symbol* s) const {
+  size_t i = std::upper_bound(starts_.begin(), starts_.end(), address) -
+             starts_.begin();
+  if (i == 0 || address >= ranges_[i - 1].end) {
+    return false;
+  }
+  *s = symbol{
+      .start = starts_[i - 1],
+      .size = ranges_[i - 1].end - starts_[i - 1],
+      .name = names_.name(ranges_[i - 1].name),
+      .generation = ranges_[i - 1].generation,
+  };
+  return true;
+}
+
+// Lines are "<start> <size> <name>" with hex numbers, a partial last line
+// is left for the next update.
+void jit_symbols::read_map(source& s) {
+  size_t consumed = 0;
+  while (true) {
+    size_t newline = s.pending.find('\n', consumed);
+    if (newline == std::string::npos) {
+      break;
+    }
+    std::string line = s.pending.substr(consumed, newline - consumed);
+    consumed = newline + 1;
+
+    char* end = nullptr;
+    uint64_t start = std::strtoull(line.c_str(), &end, 16);
+    if (*end != ' ') {
+      continue;
+    }
+    char* name = nullptr;
+    uint64_t size = std::strtoull(end + 1, &name, 16);
+    if (*name != ' ') {
+      continue;
+    }
+    add(start, size, name + 1);
+  }
+  s.pending.erase(0, consumed);
+}
+
+// Records are read once complete; the code following a load record is
+// skipped.
+void jit_symbols::read_dump(source& s) {
+  size_t consumed = 0;
+  if (!s.header_read) {
+    jitdump_header header;
+    if (s.pending.size() < sizeof(header)) {
+      return;
+    }
+    std::memcpy(&header, s.pending.data(), sizeof(header));
+    if (header.magic != kJitdumpMagic || header.total_size < sizeof(header)) {
+      close_source(s);  // another byte order, or not a jitdump file at all
+      return;
+    }
+    if (s.pending.size() < header.total_size) {
+      return;
+    }
+    consumed = header.total_size;
+    s.header_read = true;
+  }
+
+  while (s.pending.size() - consumed >= sizeof(record_header)) {
+    const char* p = s.pending.data() + consumed;
+    record_header header;
+    std::memcpy(&header, p, sizeof(header));
+    if (header.total_size < sizeof(header)) {
+      close_source(s);  // corrupt, nothing more can be read
+      return;
+    }
+    if (s.pending.size() - consumed < header.total_size) {
+      break;
+    }
+    if (header.id == kJitCodeLoad && header.total_size > sizeof(code_load)) {
+      code_load load;
+      std::memcpy(&load, p, sizeof(load));
+      const char* name = p + sizeof(load);
+      size_t length = strnlen(name, header.total_size - sizeof(load));
+      add(load.code_addr, load.code_size, std::string_view(name, length));
+      code_names_[load.code_index] = names_.intern({name, length});
+    } else if (header.id == kJitCodeMove &&
+               header.total_size >= sizeof(code_move)) {
+      code_move move;
+      std::memcpy(&move, p, sizeof(move));
+      if (auto it = code_names_.find(move.code_index);
+          it != code_names_.end()) {
+        add(move.new_code_addr, move.code_size, names_.name(it->second));
+      }
+    }
+    consumed += header.total_size;
+  }
+  s.pending.erase(0, consumed);
+}
+
+void jit_symbols::add(uint64_t start, uint64_t size, std::string_view name) {
+  if (size == 0) {
+    return;
+  }
+  added_.push_back(added{
+      .start = start,
+      .end = start + size,
+      .name = names_.intern(name),
+      .order = added_.size() + 1,
+  });
+}
+
+// Merges the functions read by the last update into the sorted ranges in
+// one pass, only they are sorted. Of overlapping functions the one read last
+// is kept.
+void jit_symbols::merge(uint32_t generation) {
+  if (added_.empty()) {
+    return;
+  }
+  std::sort(added_.begin(), added_.end(), [](const added& a, const added& b) {
+    if (a.start != b.start) {
+      return a.start < b.start;
+    }
+    return a.order < b.order;
+  });
+
+  struct entry {
+    uint64_t start;
+    uint64_t end;
+    uint32_t name;
+    uint32_t generation;
+    size_t order;  // 0 for ranges already merged
+  };
+  // kept ranges do not overlap, so only the last one can overlap the next
+  std::vector<entry> kept;
+  kept.reserve(starts_.size() + added_.size());
+  auto keep = [&](const entry& e) {
+    while (!kept.empty() && kept.back().end > e.start) {
+      if (kept.back().order > e.order) {
+        return;
+      }
+      kept.pop_back();
+    }
+    kept.push_back(e);
+  };
+  // of ranges at one start the merged one is older and goes first
+  size_t i = 0;
+  auto keep_merged = [&](uint64_t until) {
+    for (; i < starts_.size() && starts_[i] <= until; ++i) {
+      keep({starts_[i], ranges_[i].end, ranges_[i].name,
+            ranges_[i].generation, 0});
+    }
+  };
+  for (const added& a : added_) {
+    keep_merged(a.start);
+    keep({a.start, a.end, a.name, generation, a.order});
+    loaded_.push_back(loaded_range{a.start, a.end, generation});
+  }
+  keep_merged(UINT64_MAX);
+  added_.clear();
+
+  starts_.clear();
+  ranges_.clear();
+  for (const entry& e : kept) {
+    starts_.push_back(e.start);
+    ranges_.push_back(range{e.end, e.name, e.generation});
+  }
+}
+
+#endif  // defined(__linux__)
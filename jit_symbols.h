@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "string_table.h"
+
+// Functions a JIT compiler generated at run time, read from the files perf
+// reads them from: /tmp/perf-<pid>.map with a "start size name" line per
+// function, and jitdump files the JIT maps into the target. Both are only
+// ever appended to, so each update() reads just what was appended since the
+// previous one. Code loaded later replaces what it overlaps, as the JIT
+// reuses the memory of code it freed; functions carry the generation of the
+// update that read them, so symbols of the code they replaced are known to
+// be stale.
+class jit_symbols {
+ public:
+  jit_symbols() = default;
+  ~jit_symbols();
+
+  jit_symbols(const jit_symbols&) = delete;
+  jit_symbols& operator=(const jit_symbols&) = delete;
+
+  // |root| is the root directory of the target, /tmp/perf-<pid>.map is
+  // looked up below it.
+  void attach(uint32_t pid, const std::string& root);
+  void detach();
+
+  // Follows the jitdump file at |path| too, as the target sees it, once it
+  // shows up in the mappings of the target. Files already followed are
+  // ignored.
+  void add_dump(const std::string& path);
+
+  // Reads what was appended to the files since the previous call, the
+  // functions read get |generation|.
+  void update(uint32_t generation);
+
+  struct symbol {
+    uint64_t start;
+    uint64_t size;
+    std::string_view name;
+    uint32_t generation;
+  };
+  bool find(uint64_t address, symbol* s) const;
+
+  // Address ranges of the functions read since the previous call.
+  struct loaded_range {
+    uint64_t start;
+    uint64_t end;
+    uint32_t generation;
+  };
+  std::vector<loaded_range> take_loaded();
+
+  size_t size() const { return starts_.size(); }
+
+ private:
+  // a file being followed
+  struct source {
+    std::string path;
+    int fd;  // -1 once the file cannot be read on
+    bool dump;
+    bool header_read;  // jitdump files start with a header of their own
+    uint64_t offset;   // read up to here
+    std::string pending;  // a partial line or record at the end
+  };
+  struct range {
+    uint64_t end;
+    uint32_t name;
+    uint32_t generation;
+  };
+  // a function read since the last merge
+  struct added {
+    uint64_t start;
+    uint64_t end;
+    uint32_t name;
+    size_t order;  // 1 for the first one read since the last merge
+  };
+
+  bool open_source(const std::string& path, bool dump);
+  void close_source(source& s);
+  void read_map(source& s);
+  void read_dump(source& s);
+  void add(uint64_t start, uint64_t size, std::string_view name);
+  void merge(uint32_t generation);
+
+  std::string root_;
+  std::string map_path_;  // of the perf map, opened once it exists
+  std::vector<source> sources_;
+  // sorted and non-overlapping, kept apart from the rest for the binary
+  // search
+  std::vector<uint64_t> starts_;
+  std::vector<range> ranges_;
+  std::vector<added> added_;
+  std::vector<loaded_range> loaded_;
+  // names of jitdump code by code index, for records moving it
+  std::unordered_map<uint64_t, uint32_t> code_names_;
+  string_table names_;
+};
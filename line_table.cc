@@ -0,0 +1,257 @@
+#include "line_table.h"
+
+#include <algorithm>
+
+namespace {
+
+// line number program opcodes
+constexpr uint8_t kLnsCopy = 1;
+constexpr uint8_t kLnsAdvancePc = 2;
+constexpr uint8_t kLnsAdvanceLine = 3;
+constexpr uint8_t kLnsSetFile = 4;
+constexpr uint8_t kLnsConstAddPc = 8;
+constexpr uint8_t kLnsFixedAdvancePc = 9;
+constexpr uint8_t kLneEndSequence = 1;
+constexpr uint8_t kLneSetAddress = 2;
+constexpr uint8_t kLneDefineFile = 3;
+
+void put_uleb(uint64_t value, std::vector<uint8_t>* out) {
+  do {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    out->push_back(byte | (value ? 0x80 : 0));
+  } while (value);
+}
+
+void put_sleb(int64_t value, std::vector<uint8_t>* out) {
+  while (true) {
+    uint8_t byte = value & 0x7f;
+    value >>= 7;
+    if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40))) {
+      out->push_back(byte);
+      return;
+    }
+    out->push_back(byte | 0x80);
+  }
+}
+
+}  // namespace
+
+void line_table::build(const dwarf::sections& sections) {
+  std::vector<row> rows;
+  dwarf::for_each_unit(sections.line, [&](std::span<const uint8_t> unit) {
+    decode_unit(unit, sections, &rows);
+  });
+  pack(rows);
+}
+
+// Runs the line number program of one unit and appends its rows. Sequences
+// starting at address 0 belong to functions the linker discarded.
+bool line_table::decode_unit(std::span<const uint8_t> unit,
+                             const dwarf::sections& sections,
+                             std::vector<row>* rows) {
+  dwarf::line_header header;
+  if (!dwarf::read_line_header(unit, sections, &header)) {
+    return false;
+  }
+  // file indices of the program mapped to ids of this table
+  std::vector<uint32_t> files;
+  for (const auto& path : header.files) {
+    files.push_back(intern_file(path));
+  }
+
+  // state machine of the line number program
+  dwarf::reader r(header.program);
+  uint8_t min_instruction_length = header.min_instruction_length;
+  int8_t line_base = header.line_base;
+  uint8_t line_range = header.line_range;
+  uint8_t opcode_base = header.opcode_base;
+  uint64_t address = 0;
+  uint64_t file = 1;
+  int64_t line = 1;
+  std::vector<row> sequence;
+  auto emit = [&] {
+    uint32_t id = file < files.size() ? files[file] : 0;
+    sequence.push_back(row{address, id, (uint32_t)std::max<int64_t>(line, 0)});
+  };
+  while (!r.done() && r.ok) {
+    uint8_t opcode = r.u8();
+    if (opcode >= opcode_base) {
+      int adjusted = opcode - opcode_base;
+      address += (adjusted / line_range) * min_instruction_length;
+      line += line_base + adjusted % line_range;
+      emit();
+      continue;
+    }
+    switch (opcode) {
+      case 0: {
+        uint64_t length = r.uleb();
+        const uint8_t* next = r.p + std::min<uint64_t>(length, r.end - r.p);
+        uint8_t extended = length ? r.u8() : 0;
+        if (extended == kLneEndSequence) {
+          // the end row marks where the sequence stops covering addresses
+          line = 0;
+          emit();
+          if (sequence.front().address != 0) {
+            rows->insert(rows->end(), sequence.begin(), sequence.end());
+          }
+          sequence.clear();
+          address = 0;
+          file = 1;
+          line = 1;
+        } else if (extended == kLneSetAddress) {
+          address = r.fixed(std::min<uint64_t>(length - 1, 8));
+        } else if (extended == kLneDefineFile) {
+          std::string_view name = r.str();
+          uint64_t directory = r.uleb();
+          files.push_back(intern_file(dwarf::join_path(
+              directory < header.directories.size()
+                  ? std::string_view(header.directories[directory])
+                  : std::string_view(),
+              name)));
+        }
+        r.p = next;
+        break;
+      }
+      case kLnsCopy:
+        emit();
+        break;
+      case kLnsAdvancePc:
+        address += r.uleb() * min_instruction_length;
+        break;
+      case kLnsAdvanceLine:
+        line += r.sleb();
+        break;
+      case kLnsSetFile:
+        file = r.uleb();
+        break;
+      case kLnsConstAddPc:
+        address += ((255 - opcode_base) / line_range) * min_instruction_length;
+        break;
+      case kLnsFixedAdvancePc:
+        address += r.u16();
+        break;
+      default:
+        // column, negate_stmt, basic_block, prologue_end, ... are not kept
+        for (int i = 0; i < header.opcode_lengths[opcode]; ++i) {
+          r.uleb();
+        }
+        break;
+    }
+  }
+  return r.ok;
+}
+
+uint32_t line_table::intern_file(std::string path) {
+  auto [it, inserted] = file_ids_.emplace(std::move(path), files_.size());
+  if (inserted) {
+    files_.push_back(it->first);
+  }
+  return it->second;
+}
+
+void line_table::pack(std::vector<row>& rows) {
+  // of rows at one address the last one applies, except that the end row
+  // of a sequence never replaces the start of the next one
+  std::stable_sort(rows.begin(), rows.end(), [](const row& a, const row& b) {
+    return a.address < b.address;
+  });
+  std::vector<row> unique;
+  for (const row& r : rows) {
+    if (!unique.empty() && unique.back().address == r.address) {
+      if (r.line != 0 || unique.back().line == 0) {
+        unique.back() = r;
+      }
+    } else {
+      unique.push_back(r);
+    }
+  }
+
+  decoded_addresses_.clear();
+  decoded_blocks_.clear();
+  decoded_deltas_.clear();
+  for (size_t i = 0; i < unique.size(); ++i) {
+    const row& r = unique[i];
+    if (i % kBlockRows == 0) {
+      decoded_addresses_.push_back(r.address);
+      decoded_blocks_.push_back(
+          block{(uint32_t)decoded_deltas_.size(), r.file, r.line});
+      continue;
+    }
+    const row& previous = unique[i - 1];
+    put_uleb(r.address - previous.address, &decoded_deltas_);
+    put_sleb((int64_t)r.file - previous.file, &decoded_deltas_);
+    put_sleb((int64_t)r.line - previous.line, &decoded_deltas_);
+  }
+  rows_ = unique.size();
+  decoded_addresses_.shrink_to_fit();
+  decoded_blocks_.shrink_to_fit();
+  decoded_deltas_.shrink_to_fit();
+  addresses_ = decoded_addresses_;
+  blocks_ = decoded_blocks_;
+  deltas_ = decoded_deltas_;
+}
+
+void line_table::save(symbol_cache::writer* cache) const {
+  uint64_t rows = rows_;
+  cache->add<uint64_t>(symbol_cache::kLineAddresses, addresses_);
+  cache->add<block>(symbol_cache::kLineBlocks, blocks_);
+  cache->add<uint8_t>(symbol_cache::kLineDeltas, deltas_);
+  cache->add<uint64_t>(symbol_cache::kLineRows, {&rows, 1});
+  cache->add_strings(symbol_cache::kLineFiles, files_);
+}
+
+// Block offsets are checked so find() stays within the deltas; file ids are
+// checked by find() itself.
+bool line_table::load(const symbol_cache& cache) {
+  auto addresses = cache.array<uint64_t>(symbol_cache::kLineAddresses);
+  auto blocks = cache.array<block>(symbol_cache::kLineBlocks);
+  auto deltas = cache.array<uint8_t>(symbol_cache::kLineDeltas);
+  auto rows = cache.array<uint64_t>(symbol_cache::kLineRows);
+  if (rows.size() != 1 || addresses.size() != blocks.size()) {
+    return false;
+  }
+  for (size_t i = 0; i < blocks.size(); ++i) {
+    if (blocks[i].offset > deltas.size() ||
+        (i > 0 && blocks[i].offset < blocks[i - 1].offset)) {
+      return false;
+    }
+  }
+  addresses_ = addresses;
+  blocks_ = blocks;
+  deltas_ = deltas;
+  rows_ = rows[0];
+  files_ = cache.strings(symbol_cache::kLineFiles);
+  return true;
+}
+
+bool line_table::find(uint64_t address,
+                      std::string_view* file,
+                      uint32_t* line) const {
+  size_t i = std::upper_bound(addresses_.begin(), addresses_.end(), address) -
+             addresses_.begin();
+  if (i == 0) {
+    return false;
+  }
+  const block& b = blocks_[i - 1];
+  size_t end = i < blocks_.size() ? blocks_[i].offset : deltas_.size();
+  dwarf::reader r({deltas_.data() + b.offset, end - b.offset});
+  uint64_t row_address = addresses_[i - 1];
+  int64_t row_file = b.file;
+  int64_t row_line = b.line;
+  while (!r.done()) {
+    uint64_t next_address = row_address + r.uleb();
+    if (next_address > address) {
+      break;
+    }
+    row_address = next_address;
+    row_file += r.sleb();
+    row_line += r.sleb();
+  }
+  if (row_line == 0 || (size_t)row_file >= files_.size()) {
+    return false;
+  }
+  *file = files_[row_file];
+  *line = (uint32_t)row_line;
+  return true;
+}
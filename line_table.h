@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+#include "dwarf.h"
+#include "symbol_cache.h"
+
+// Source lines of one module, decoded from its DWARF .debug_line section.
+// Rows are sorted by address and packed in blocks: the first row of a block
+// is stored in full, the rest as varint deltas to the previous row. A lookup
+// binary searches the block starts and decodes at most one block.
+class line_table {
+ public:
+  // Decodes every line program of .debug_line. Units that cannot be decoded
+  // are skipped.
+  void build(const dwarf::sections& sections);
+
+  // Stores the packed rows in |cache|, or serves them from it, which must
+  // then outlive the table. load() returns false if |cache| has no table or
+  // an inconsistent one.
+  void save(symbol_cache::writer* cache) const;
+  bool load(const symbol_cache& cache);
+
+  // Finds the row covering link-time address |address|.
+  bool find(uint64_t address, std::string_view* file, uint32_t* line) const;
+
+  size_t size() const { return rows_; }
+
+ private:
+  static constexpr int kBlockRows = 16;
+
+  struct row {
+    uint64_t address;
+    uint32_t file;
+    uint32_t line;  // 0 past the end of a sequence
+  };
+  struct block {
+    uint32_t offset;  // of the deltas following the first row
+    uint32_t file;
+    uint32_t line;
+  };
+
+  bool decode_unit(std::span<const uint8_t> unit,
+                   const dwarf::sections& sections,
+                   std::vector<row>* rows);
+  uint32_t intern_file(std::string path);
+  void pack(std::vector<row>& rows);
+
+  // sorted, kept apart from the rest for the binary search; in the cache
+  // the table was loaded from or in the decoded arrays below
+  std::span<const uint64_t> addresses_;
+  std::span<const block> blocks_;
+  std::span<const uint8_t> deltas_;
+  size_t rows_ = 0;
+  std::vector<std::string_view> files_;  // keys of file_ids_ or in the cache
+
+  std::vector<uint64_t> decoded_addresses_;
+  std::vector<block> decoded_blocks_;
+  std::vector<uint8_t> decoded_deltas_;
+  std::unordered_map<std::string, uint32_t> file_ids_;
+};
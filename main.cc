@@ -1,13 +1,68 @@
 #include "tracer.h"
 
+#include <algorithm>
 #include <iostream>
 #include <memory>
-
-#include "uwu.h"
+#include <optional>
+#include <string>
 
 #include <json.hpp>
 
+#if defined(_WIN32)
+#include "uwu.h"
+
 #include <Windows.h>
+#endif
+
+namespace {
+
+// Handles a message of the web view. Returns the reply to send back, if any.
+std::optional<nlohmann::json> handle_message(tracer* tracer,
+                                             const nlohmann::json& req) {
+  std::string type = req.value("type", "");
+  if (type == "process") {
+    std::string rule = req.value("rule", "");
+
+    std::optional<process::process_info> proc;
+    auto process_snapshot = process::snapshot();
+    if (!process_snapshot) {
+      // nothing to match against
+    } else if (std::regex_match(rule, std::regex("\\d+"))) {
+      auto it = std::find_if(process_snapshot->processes.begin(),
+                   process_snapshot->processes.end(),
+                   [&](const auto& p) { return p.id == std::stoul(rule); });
+      if (it != process_snapshot->processes.end()) {
+        proc = *it;
+      }
+    } else {
+      proc = process_snapshot->find(std::regex(rule));
+    }
+
+    if (proc && proc->id > 0) {
+      tracer->start(proc->id);
+    } else {
+      tracer->stop();
+    }
+  } else if (type == "pause") {
+    tracer->pause();
+  } else if (type == "thread") {
+    int thread = req.value("thread", 0);
+    tracer->select(thread);
+  } else if (type == "config") {
+    tracer->configure(req.value("config", nlohmann::json::object()));
+  } else if (type == "snapshot") {
+    nlohmann::json data = tracer->snapshot();
+    return nlohmann::json{
+        {"type", "snapshot"},
+        {"data", data},
+    };
+  }
+  return std::nullopt;
+}
+
+}  // namespace
+
+#if defined(_WIN32)
 
 int WINAPI wWinMain(HINSTANCE hInstance,
                     HINSTANCE hPrevInstance,
@@ -23,42 +78,9 @@ int WINAPI wWinMain(HINSTANCE hInstance,
   // browser.navigate("https://livetrace/index.html");
   browser.navigate("http://localhost:5173");
   browser.on_message([&](const std::string& msg) {
-    nlohmann::json req = nlohmann::json::parse(msg);
-
-    std::string type = req["type"];
-    if (type == "process") {
-      std::string rule = req.value("rule", "");
-
-      std::optional<process::process_info> proc;
-      auto process_snapshot = process::snapshot();
-      if (std::regex_match(rule, std::regex("\\d+"))) {
-        auto it = std::find_if(process_snapshot->processes.begin(),
-                     process_snapshot->processes.end(),
-                     [&](const auto& p) { return p.id == std::stoi(rule); });
-        if (it != process_snapshot->processes.end()) {
-          proc = *it;
-        }
-      } else {
-        proc = process_snapshot->find(std::regex(rule));
-      }
-
-      if (proc && proc->id > 0) {
-        tracer->start(proc->id);
-      } else {
-        tracer->stop();
-      }
-    } else if (type == "pause") {
-      tracer->pause();
-    } else if (type == "thread") {
-      int thread = req.value("thread", 0);
-      tracer->select(thread);
-    } else if (type == "snapshot") {
-      nlohmann::json data = tracer->snapshot();
-      nlohmann::json json = {
-          {"type", "snapshot"},
-          {"data", data},
-      };
-      browser.message(json.dump(2));
+    if (auto reply = handle_message(tracer.get(),
+                                    nlohmann::json::parse(msg))) {
+      browser.message(reply->dump(2));
     }
   });
   browser.devtools();
@@ -68,4 +90,36 @@ int WINAPI wWinMain(HINSTANCE hInstance,
   tracer->stop();
 
   return 0;
-}
\ No newline at end of file
+}
+
+#else
+
+// Without a web view the same messages are read from stdin, one per line,
+// and replies are written to stdout the same way. A target given on the
+// command line, as a pid or a regex, is attached to right away.
+int main(int argc, char** argv) {
+  auto tracer = std::make_unique<::tracer>();
+  if (argc > 1) {
+    handle_message(tracer.get(), {{"type", "process"}, {"rule", argv[1]}});
+  }
+
+  std::string line;
+  while (std::getline(std::cin, line)) {
+    nlohmann::json req = nlohmann::json::parse(line, nullptr, false);
+    if (req.is_discarded() || !req.is_object()) {
+      if (!line.empty()) {
+        std::cerr << "livetrace: not a message: " << line << std::endl;
+      }
+      continue;
+    }
+    if (auto reply = handle_message(tracer.get(), req)) {
+      std::cout << reply->dump() << std::endl;
+    }
+  }
+
+  tracer->stop();
+
+  return 0;
+}
+
+#endif
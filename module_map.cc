@@ -0,0 +1,137 @@
+#if defined(__linux__)
+
+#include "module_map.h"
+
+#include <cstdio>
+
+void module_map::attach(uint32_t pid) {
+  detach();
+  pid_ = pid;
+}
+
+void module_map::detach() {
+  text_.clear();
+  mappings_.clear();
+  added_.clear();
+}
+
+// The file is read in full before it is compared, the kernel generates it
+// on every read.
+bool module_map::update() {
+  std::string path = "/proc/" + std::to_string(pid_) + "/maps";
+  FILE* file = std::fopen(path.c_str(), "r");
+  if (!file) {
+    return false;
+  }
+  std::string text;
+  char buffer[16 * 1024];
+  while (size_t n = std::fread(buffer, 1, sizeof(buffer), file)) {
+    text.append(buffer, n);
+  }
+  std::fclose(file);
+  return update(std::move(text));
+}
+
+bool module_map::update(std::string text) {
+  if (text == text_) {
+    return false;
+  }
+  text_ = std::move(text);
+
+  std::unordered_map<key, mapping, key_hash> mappings;
+  std::vector<mapping> listed;  // not at the same place before
+  for (size_t at = 0; at < text_.size();) {
+    size_t newline = text_.find('\n', at);
+    if (newline == std::string::npos) {
+      newline = text_.size();
+    }
+    std::string line = text_.substr(at, newline - at);
+    at = newline + 1;
+
+    mapping m;
+    if (!parse(line, &m)) {
+      continue;
+    }
+    if (auto it = mappings_.find(key_of(m)); it != mappings_.end()) {
+      m.generation = it->second.generation;
+      mappings.emplace(key_of(m), std::move(m));
+    } else {
+      listed.push_back(std::move(m));
+    }
+  }
+  bool added = false;
+  for (mapping& m : listed) {
+    m.generation = previous_generation(m);
+    if (m.generation == 0 && m.inode != 0) {
+      if (!added) {
+        generation_++;
+        added = true;
+      }
+      m.generation = generation_;
+      added_.push_back(m);
+    }
+    mappings.emplace(key_of(m), std::move(m));
+  }
+  mappings_ = std::move(mappings);
+  return true;
+}
+
+std::vector<module_map::mapping> module_map::take_added() {
+  std::vector<mapping> added;
+  added.swap(added_);
+  return added;
+}
+
+// Only executable mappings are kept, the rest is skipped on the permissions
+// alone.
+bool module_map::parse(const std::string& line, mapping* m) const {
+  size_t perms_at = line.find(' ') + 1;
+  if (perms_at == 0 || perms_at + 2 >= line.size() ||
+      line[perms_at + 2] != 'x') {
+    return false;
+  }
+  unsigned long long start = 0, end = 0, offset = 0, inode = 0;
+  unsigned int major = 0, minor = 0;
+  char perms[8]{};
+  int name_at = 0;
+  if (std::sscanf(line.c_str(), "%llx-%llx %7s %llx %x:%x %llu %n", &start,
+                  &end, perms, &offset, &major, &minor, &inode,
+                  &name_at) < 7) {
+    return false;
+  }
+  std::string path = line.substr(name_at);
+  while (!path.empty() && path.back() == ' ') {
+    path.pop_back();
+  }
+  constexpr std::string_view kDeleted = " (deleted)";
+  bool deleted = path.ends_with(kDeleted);
+  if (deleted) {
+    path.resize(path.size() - kDeleted.size());
+  }
+  *m = mapping{
+      .start = start,
+      .end = end,
+      .offset = offset,
+      .dev = (uint64_t)major << 32 | minor,
+      .inode = inode,
+      .path = std::move(path),
+      .deleted = deleted,
+      .generation = 0,
+  };
+  return true;
+}
+
+// Splitting a mapping, e.g. by mprotect of part of it, or merging one again
+// keeps the file at the same place.
+uint32_t module_map::previous_generation(const mapping& m) const {
+  for (const auto& [k, previous] : mappings_) {
+    if (previous.dev == m.dev && previous.inode == m.inode &&
+        previous.start - previous.offset == m.start - m.offset &&
+        previous.start < m.end && m.start < previous.end) {
+      return previous.generation;
+    }
+  }
+  return 0;
+}
+
+#endif  // defined(__linux__)
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "flat_map.h"
+
+// Executable mappings of a Linux process, from /proc/<pid>/maps. Each
+// update() reads the file again; if its text is unchanged nothing is parsed,
+// otherwise mappings are matched by range, offset and file, and only ones not
+// listed before get the next generation. Symbols stamped with the generation
+// of their mapping are stale once a newer mapping covers their address, e.g.
+// after a library was unloaded and another one loaded in its place. A file
+// that was deleted, or a mapping split by mprotect, keeps its generation.
+// Anonymous mappings, where JITs put their code, change bounds all the time
+// and are left at generation 0; jit_symbols versions the code in them.
+class module_map {
+ public:
+  struct mapping {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;  // in the file
+    uint64_t dev;     // major << 32 | minor
+    uint64_t inode;   // 0 for anonymous mappings
+    std::string path;  // without the " (deleted)" suffix
+    bool deleted;      // the path is gone or names another file now
+    uint32_t generation;  // of the update that first listed the file there
+  };
+
+  void attach(uint32_t pid);
+  void detach();
+
+  // Reads the mappings again. Returns true if they changed since the
+  // previous call.
+  bool update();
+  // Same with |text| as the contents of the maps file.
+  bool update(std::string text);
+
+  template <typename F>
+  void for_each(F&& fn) const {
+    for (const auto& [k, m] : mappings_) {
+      fn(m);
+    }
+  }
+
+  // Mappings listed since the previous call, in no particular order.
+  std::vector<mapping> take_added();
+
+  // A generation newer than every mapping listed so far, for code versioned
+  // elsewhere.
+  uint32_t next_generation() { return ++generation_; }
+
+ private:
+  struct key {
+    uint64_t start;
+    uint64_t end;
+    uint64_t offset;
+    uint64_t dev;
+    uint64_t inode;
+    bool operator==(const key&) const = default;
+  };
+  struct key_hash {
+    // no two mappings listed at once share a start
+    uint64_t operator()(const key& k) const {
+      return flat_hash<uint64_t>{}(k.start);
+    }
+  };
+  static key key_of(const mapping& m) {
+    return key{m.start, m.end, m.offset, m.dev, m.inode};
+  }
+
+  bool parse(const std::string& line, mapping* m) const;
+  // Generation of a previous mapping of the same file at the same place that
+  // overlaps |m|, 0 if there is none.
+  uint32_t previous_generation(const mapping& m) const;
+
+  uint32_t pid_ = 0;
+  uint32_t generation_ = 0;
+  std::string text_;  // of the previous read
+  std::unordered_map<key, mapping, key_hash> mappings_;
+  std::vector<mapping> added_;
+};
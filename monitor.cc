@@ -1,5 +1,7 @@
 #include "monitor.h"
 
+#if defined(_WIN32)
+
 #include <windows.h>
 #include <psapi.h>
 
@@ -99,3 +101,122 @@ uint64_t Monitor::virt_mem_usage(uint32_t pid) {
   return pmc.PrivateUsage;
 }
 
+#elif defined(__linux__)
+
+#include <sys/sysinfo.h>
+#include <unistd.h>
+
+#include <cfloat>
+#include <chrono>
+#include <fstream>
+#include <string>
+
+namespace {
+
+// /proc/<pid>/statm, in pages
+bool read_statm(uint32_t pid, uint64_t* size, uint64_t* resident) {
+  std::ifstream ifs("/proc/" + std::to_string(pid) + "/statm");
+  return (bool)(ifs >> *size >> *resident);
+}
+
+// utime + stime of /proc/<pid>/stat, in clock ticks
+bool read_stat_time(const std::string& path, uint64_t* ticks) {
+  std::ifstream ifs(path);
+  std::string stat((std::istreambuf_iterator<char>(ifs)), {});
+  size_t pos = stat.rfind(')');
+  if (pos == std::string::npos) {
+    return false;
+  }
+  std::istringstream iss(stat.substr(pos + 2));
+  std::string field;
+  for (int i = 3; i < 14; ++i) {
+    iss >> field;
+  }
+  uint64_t utime = 0, stime = 0;
+  if (!(iss >> utime >> stime)) {
+    return false;
+  }
+  *ticks = utime + stime;
+  return true;
+}
+
+}  // namespace
+
+double Monitor::cpu_usage() {
+  std::ifstream ifs("/proc/stat");
+  std::string cpu;
+  uint64_t user, nice, system, idle, iowait, irq, softirq;
+  if (!(ifs >> cpu >> user >> nice >> system >> idle >> iowait >> irq >> softirq)) {
+    return DBL_MIN;
+  }
+  static uint64_t prev_busy, prev_total;
+  uint64_t busy = user + nice + system + irq + softirq;
+  uint64_t total = busy + idle + iowait;
+  double usage = (double)(busy - prev_busy) / (double)(total - prev_total);
+  prev_busy = busy;
+  prev_total = total;
+  return usage;
+}
+
+double Monitor::cpu_usage(uint32_t pid) {
+  static std::chrono::steady_clock::time_point prev_time;
+  static uint64_t prev_ticks;
+
+  uint64_t ticks = 0;
+  if (!read_stat_time("/proc/" + std::to_string(pid) + "/stat", &ticks)) {
+    return DBL_MIN;
+  }
+  auto now = std::chrono::steady_clock::now();
+  double elapsed = std::chrono::duration<double>(now - prev_time).count();
+  double usage = (double)(ticks - prev_ticks) / ::sysconf(_SC_CLK_TCK);
+  usage /= elapsed;
+  usage /= ::get_nprocs();
+
+  prev_time = now;
+  prev_ticks = ticks;
+  return usage;
+}
+
+uint64_t Monitor::total_phys_mem() {
+  struct sysinfo info {};
+  ::sysinfo(&info);
+  return (uint64_t)info.totalram * info.mem_unit;
+}
+
+uint64_t Monitor::total_virt_mem() {
+  struct sysinfo info {};
+  ::sysinfo(&info);
+  return (uint64_t)(info.totalram + info.totalswap) * info.mem_unit;
+}
+
+uint64_t Monitor::phys_mem_usage() {
+  struct sysinfo info {};
+  ::sysinfo(&info);
+  return (uint64_t)(info.totalram - info.freeram) * info.mem_unit;
+}
+
+uint64_t Monitor::phys_mem_usage(uint32_t pid) {
+  uint64_t size = 0, resident = 0;
+  if (!read_statm(pid, &size, &resident)) {
+    return -1;
+  }
+  return resident * ::sysconf(_SC_PAGESIZE);
+}
+
+uint64_t Monitor::virt_mem_usage() {
+  struct sysinfo info {};
+  ::sysinfo(&info);
+  return (uint64_t)(info.totalram - info.freeram + info.totalswap -
+                    info.freeswap) *
+         info.mem_unit;
+}
+
+uint64_t Monitor::virt_mem_usage(uint32_t pid) {
+  uint64_t size = 0, resident = 0;
+  if (!read_statm(pid, &size, &resident)) {
+    return -1;
+  }
+  return size * ::sysconf(_SC_PAGESIZE);
+}
+
+#endif
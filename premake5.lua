@@ -8,10 +8,6 @@ project "livetrace"
   language "C++"
   cppdialect "C++latest"
   targetdir "build"
-  nuget { 
-    "Microsoft.Windows.ImplementationLibrary:1.0.230824.2",
-    "Microsoft.Web.WebView2:1.0.1938.49"
-  }
   files {
     "*.cc",
     "*.h",
@@ -21,13 +17,61 @@ project "livetrace"
   pchheader "pch.h"
   forceincludes { "pch.h" }
   vpaths { ["*"] = "./" }
-  defines {
-    "NOMINMAX"
-  }
-  disablewarnings { 4554 }
+  filter "system:windows"
+    nuget {
+      "Microsoft.Windows.ImplementationLibrary:1.0.230824.2",
+      "Microsoft.Web.WebView2:1.0.1938.49"
+    }
+    defines {
+      "NOMINMAX"
+    }
+    disablewarnings { 4554 }
+  -- headless, talks the web view protocol over stdin and stdout
+  filter "system:linux"
+    kind "ConsoleApp"
+    removefiles { "uwu.cc", "uwu.h" }
+    links { "pthread" }
   filter "configurations:Debug"
     defines { "DEBUG" }
     symbols "On"
   filter "configurations:Release"
     defines { "NDEBUG" }
-    optimize "On"
\ No newline at end of file
+    optimize "On"
+  filter {}
+
+project "flat_map_bench"
+  kind "ConsoleApp"
+  language "C++"
+  cppdialect "C++latest"
+  targetdir "build"
+  files { "bench/flat_map_bench.cc" }
+  includedirs { "./" }
+  filter "configurations:Debug"
+    symbols "On"
+  filter "configurations:Release"
+    optimize "On"
+
+-- the symbolizer only exists on Linux, and so do its tests
+if os.istarget("linux") then
+  project "symbolizer_test"
+    kind "ConsoleApp"
+    language "C++"
+    cppdialect "C++latest"
+    targetdir "build"
+    files {
+      "test/symbolizer_test.cc",
+      "dwarf.cc",
+      "elf_symbolizer.cc",
+      "inline_table.cc",
+      "jit_symbols.cc",
+      "line_table.cc",
+      "module_map.cc",
+      "string_table.cc",
+      "symbol_cache.cc",
+    }
+    includedirs { "./" }
+    filter "configurations:Debug"
+      symbols "On"
+    filter "configurations:Release"
+      optimize "On"
+end
@@ -0,0 +1,87 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+// Non-overlapping [start, end) address ranges in a sorted array. Starts are
+// kept apart from the rest so the binary search only touches one dense
+// array.
+template <typename T>
+class range_table {
+ public:
+  // Returns false and keeps the table as is if the range overlaps one that
+  // is already present.
+  bool insert(uint64_t start, uint64_t end, T value) {
+    if (start >= end) {
+      return false;
+    }
+    size_t i = std::upper_bound(starts_.begin(), starts_.end(), start) -
+               starts_.begin();
+    if ((i > 0 && ends_[i - 1] > start) ||
+        (i < starts_.size() && starts_[i] < end)) {
+      return false;
+    }
+    starts_.insert(starts_.begin() + i, start);
+    ends_.insert(ends_.begin() + i, end);
+    values_.insert(values_.begin() + i, std::move(value));
+    return true;
+  }
+
+  // Removes the ranges overlapping [start, end).
+  void erase(uint64_t start, uint64_t end) {
+    size_t first = std::upper_bound(starts_.begin(), starts_.end(), start) -
+                   starts_.begin();
+    if (first > 0 && ends_[first - 1] > start) {
+      first--;
+    }
+    size_t last = std::lower_bound(starts_.begin(), starts_.end(), end) -
+                  starts_.begin();
+    if (first >= last) {
+      return;
+    }
+    starts_.erase(starts_.begin() + first, starts_.begin() + last);
+    ends_.erase(ends_.begin() + first, ends_.begin() + last);
+    values_.erase(values_.begin() + first, values_.begin() + last);
+  }
+
+  const T* find(uint64_t address) const {
+    size_t i = std::upper_bound(starts_.begin(), starts_.end(), address) -
+               starts_.begin();
+    if (i == 0 || address >= ends_[i - 1]) {
+      return nullptr;
+    }
+    return &values_[i - 1];
+  }
+
+  size_t size() const { return starts_.size(); }
+
+  // Removes the ranges |fn(start, end, value)| returns true for.
+  template <typename F>
+  void erase_if(F&& fn) {
+    size_t kept = 0;
+    for (size_t i = 0; i < starts_.size(); ++i) {
+      if (fn(starts_[i], ends_[i], values_[i])) {
+        continue;
+      }
+      starts_[kept] = starts_[i];
+      ends_[kept] = ends_[i];
+      values_[kept] = std::move(values_[i]);
+      kept++;
+    }
+    starts_.resize(kept);
+    ends_.resize(kept);
+    values_.resize(kept);
+  }
+
+  void clear() {
+    starts_.clear();
+    ends_.clear();
+    values_.clear();
+  }
+
+ private:
+  std::vector<uint64_t> starts_;
+  std::vector<uint64_t> ends_;
+  std::vector<T> values_;
+};
@@ -0,0 +1,79 @@
+#include "scheduler.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <thread>
+
+#if defined(_WIN32)
+#include <windows.h>
+#include <wil/resource.h>
+#elif defined(__linux__)
+#include <time.h>
+#endif
+
+void scheduler::reset(double frequency, double jitter) {
+  frequency_ = std::clamp(frequency, 10.0, 10000.0);
+  jitter_ = std::clamp(jitter, 0.0, 1.0);
+  period_ = std::chrono::duration_cast<clock::duration>(
+      std::chrono::duration<double>(1.0 / frequency_));
+  start_ = clock::now();
+  tick_ = 0;
+  overruns_ = 0;
+}
+
+scheduler::clock::time_point scheduler::wait() {
+  auto now = clock::now();
+  auto deadline = start_ + period_ * ++tick_;
+  if (now > deadline) {
+    // skip deadlines missed entirely
+    uint64_t missed = (now - deadline) / period_;
+    overruns_ += missed;
+    tick_ += missed;
+    deadline += period_ * missed;
+  }
+
+  if (jitter_ > 0) {
+    std::uniform_real_distribution<double> dist(-jitter_ / 2, jitter_ / 2);
+    deadline += std::chrono::duration_cast<clock::duration>(period_ *
+                                                            dist(random_));
+  }
+  if (deadline > now) {
+    sleep_until(deadline);
+  }
+  return clock::now();
+}
+
+void scheduler::sleep_until(clock::time_point deadline) {
+#if defined(_WIN32)
+  // waitable timers only take wall clock absolute times, so wait for the
+  // remaining duration on a high resolution timer instead
+  static thread_local wil::unique_handle timer(::CreateWaitableTimerExW(
+      NULL, NULL, CREATE_WAITABLE_TIMER_HIGH_RESOLUTION, TIMER_ALL_ACCESS));
+  auto remaining = deadline - clock::now();
+  if (remaining <= clock::duration::zero()) {
+    return;
+  }
+  LARGE_INTEGER due{};
+  due.QuadPart = -std::max<LONGLONG>(
+      1, std::chrono::duration_cast<std::chrono::nanoseconds>(remaining)
+                 .count() /
+             100);
+  if (timer && ::SetWaitableTimer(timer.get(), &due, 0, NULL, NULL, FALSE)) {
+    ::WaitForSingleObject(timer.get(), INFINITE);
+  } else {
+    std::this_thread::sleep_until(deadline);
+  }
+#elif defined(__linux__)
+  // steady_clock is CLOCK_MONOTONIC
+  auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                deadline.time_since_epoch())
+                .count();
+  timespec ts{.tv_sec = (time_t)(ns / 1000000000),
+              .tv_nsec = (long)(ns % 1000000000)};
+  while (::clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr) ==
+         EINTR) {
+  }
+#else
+  std::this_thread::sleep_until(deadline);
+#endif
+}
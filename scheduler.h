@@ -0,0 +1,35 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <random>
+
+// Paces the sampling loop at a fixed frequency. Deadlines are absolute
+// (start + n * period) so the time spent sampling does not accumulate as
+// drift. Deadlines that already passed are skipped and counted as overruns.
+class scheduler {
+ public:
+  using clock = std::chrono::steady_clock;
+
+  // |jitter| is a fraction of the period; each deadline is moved by a random
+  // offset within +-jitter/2 to avoid aliasing with periodic workloads.
+  void reset(double frequency, double jitter);
+
+  // Sleeps until the next deadline and returns the wakeup time.
+  clock::time_point wait();
+
+  double frequency() const { return frequency_; }
+  double jitter() const { return jitter_; }
+  uint64_t overruns() const { return overruns_; }
+
+ private:
+  void sleep_until(clock::time_point deadline);
+
+  double frequency_ = 0;
+  double jitter_ = 0;
+  clock::duration period_{};
+  clock::time_point start_;
+  uint64_t tick_ = 0;
+  uint64_t overruns_ = 0;
+  std::mt19937_64 random_{std::random_device{}()};
+};
@@ -0,0 +1,68 @@
+#include "sliding_window.h"
+
+#include <algorithm>
+
+void sliding_window::reset(int retention, int window) {
+  retention = std::max(retention, 1);
+  if (buckets_.size() != (size_t)retention) {
+    buckets_.assign(retention, bucket{});
+    head_ = 0;
+  }
+  window_ = std::clamp(window, 1, retention);
+
+  sums_.clear();
+  for (const auto& b : buckets_) {
+    if (b.second + window_ > head_ && b.second <= head_) {
+      b.counts.for_each([&](uint64_t key, uint64_t count) {
+        sums_[key >> 32][(uint32_t)key] += count;
+      });
+    }
+  }
+}
+
+void sliding_window::add(uint64_t second,
+                         uint32_t thread_id,
+                         uint32_t stack_id) {
+  advance(second);
+  buckets_[head_ % buckets_.size()]
+      .counts[(uint64_t)thread_id << 32 | stack_id]++;
+  sums_[thread_id][stack_id]++;
+}
+
+void sliding_window::advance(uint64_t second) {
+  if (second <= head_) {
+    return;
+  }
+  if (second - head_ >= buckets_.size()) {
+    // nothing recorded is recent enough to keep
+    for (auto& b : buckets_) {
+      b = bucket{};
+    }
+    sums_.clear();
+    head_ = second;
+    buckets_[head_ % buckets_.size()].second = head_;
+    return;
+  }
+
+  while (head_ < second) {
+    head_++;
+    // the bucket leaving the window may not have been recycled yet
+    const bucket& leaving = buckets_[(head_ - window_) % buckets_.size()];
+    if (head_ >= (uint64_t)window_ && leaving.second == head_ - window_) {
+      subtract(leaving);
+    }
+    bucket& b = buckets_[head_ % buckets_.size()];
+    b.counts.clear();
+    b.second = head_;
+  }
+}
+
+void sliding_window::subtract(const bucket& b) {
+  b.counts.for_each([&](uint64_t key, uint64_t count) {
+    auto& sum = sums_[key >> 32];
+    uint64_t* value = sum.find((uint32_t)key);
+    if (value && (*value -= count) == 0) {
+      sum.erase((uint32_t)key);
+    }
+  });
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+#include "flat_map.h"
+
+// Sample counts per (thread, stack) over the last |window| seconds. Counts
+// are kept in a ring of one second buckets covering |retention| seconds, and
+// the sum over the window is updated as buckets enter and leave it, so
+// reading it costs the same as reading the cumulative counts.
+class sliding_window {
+ public:
+  using counts = flat_map<uint32_t, uint64_t>;  // stack id -> samples
+
+  // Drops the buckets if |retention| changes, otherwise only rebuilds the
+  // window sum. |window| is clamped to |retention|.
+  void reset(int retention, int window);
+
+  // |second| is a monotonic clock in seconds and never goes backwards.
+  void add(uint64_t second, uint32_t thread_id, uint32_t stack_id);
+  void advance(uint64_t second);
+
+  int window() const { return window_; }
+  const counts& sum(uint32_t thread_id) { return sums_[thread_id]; }
+
+ private:
+  struct bucket {
+    uint64_t second = 0;
+    flat_map<uint64_t, uint64_t> counts;  // (thread << 32 | stack) -> samples
+  };
+
+  void subtract(const bucket& b);
+
+  std::vector<bucket> buckets_;
+  std::unordered_map<uint32_t, counts> sums_;
+  uint64_t head_ = 0;  // second of the newest bucket
+  int window_ = 0;
+};
@@ -0,0 +1,35 @@
+#include "stack_table.h"
+
+#include <algorithm>
+
+uint32_t stack_table::intern(std::span<const uint64_t> frames) {
+  uint64_t hash = frames.size();
+  for (uint64_t frame : frames) {
+    hash = flat_hash<uint64_t>{}(hash ^ frame);
+  }
+
+  // 0 means no stack with this hash yet
+  uint32_t& first = index_[hash];
+  uint32_t last = kNone;
+  for (uint32_t id = first ? first - 1 : kNone; id != kNone;
+       id = entries_[id].next) {
+    if (std::ranges::equal(stack(id), frames)) {
+      return id;
+    }
+    last = id;
+  }
+
+  uint32_t id = (uint32_t)entries_.size();
+  entries_.push_back(entry{
+      .offset = frames_.size(),
+      .size = (uint32_t)frames.size(),
+      .next = kNone,
+  });
+  frames_.insert(frames_.end(), frames.begin(), frames.end());
+  if (last == kNone) {
+    first = id + 1;
+  } else {
+    entries_[last].next = id;
+  }
+  return id;
+}
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+#include "flat_map.h"
+
+// Dictionary of captured stacks. Each distinct sequence of instruction
+// offsets is stored once and named by a dense id, so samples can be counted
+// per stack and expanded into per-frame aggregates only when needed.
+class stack_table {
+ public:
+  // |frames| are instruction offsets, innermost first.
+  uint32_t intern(std::span<const uint64_t> frames);
+
+  std::span<const uint64_t> stack(uint32_t id) const {
+    const entry& e = entries_[id];
+    return {frames_.data() + e.offset, e.size};
+  }
+
+  size_t size() const { return entries_.size(); }
+
+ private:
+  static constexpr uint32_t kNone = UINT32_MAX;
+
+  struct entry {
+    size_t offset;  // into frames_
+    uint32_t size;
+    uint32_t next;  // next stack with the same hash
+  };
+
+  std::vector<uint64_t> frames_;
+  std::vector<entry> entries_;
+  flat_map<uint64_t, uint32_t> index_;  // hash -> first id + 1
+};
@@ -0,0 +1,47 @@
+#include "string_table.h"
+
+#include <algorithm>
+
+string_table::string_table() {
+  clear();
+}
+
+uint32_t string_table::intern(std::string_view name) {
+  auto it = ids_.find(name);
+  if (it != ids_.end()) {
+    return it->second;
+  }
+  uint32_t id = (uint32_t)names_.size();
+  std::string_view stored = store(name);
+  names_.push_back(stored);
+  ids_.emplace(stored, id);
+  return id;
+}
+
+void string_table::clear() {
+  chunks_.clear();
+  large_.clear();
+  used_ = kChunkSize;
+  names_.assign(1, std::string_view());
+  ids_.clear();
+  ids_.emplace(std::string_view(), 0);
+}
+
+// Copies |name| into the current chunk. Names longer than a chunk get an
+// allocation of their own.
+std::string_view string_table::store(std::string_view name) {
+  char* p;
+  if (name.size() > kChunkSize) {
+    large_.push_back(std::make_unique<char[]>(name.size()));
+    p = large_.back().get();
+  } else {
+    if (used_ + name.size() > kChunkSize) {
+      chunks_.push_back(std::make_unique<char[]>(kChunkSize));
+      used_ = 0;
+    }
+    p = chunks_.back().get() + used_;
+    used_ += name.size();
+  }
+  std::copy(name.begin(), name.end(), p);
+  return {p, name.size()};
+}
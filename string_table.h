@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Interns names, so each distinct string is stored once and referred to by
+// a 32-bit id. Id 0 is the empty string. Views returned by name() stay valid
+// until clear().
+class string_table {
+ public:
+  string_table();
+
+  uint32_t intern(std::string_view name);
+  std::string_view name(uint32_t id) const { return names_[id]; }
+  size_t size() const { return names_.size(); }
+
+  // Every name, by id.
+  const std::vector<std::string_view>& names() const { return names_; }
+
+  void clear();
+
+ private:
+  static constexpr size_t kChunkSize = 64 * 1024;
+
+  std::string_view store(std::string_view name);
+
+  std::vector<std::unique_ptr<char[]>> chunks_;
+  size_t used_ = kChunkSize;  // in the last chunk
+  std::vector<std::unique_ptr<char[]>> large_;
+  std::vector<std::string_view> names_;
+  std::unordered_map<std::string_view, uint32_t> ids_;
+};
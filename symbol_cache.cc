@@ -0,0 +1,169 @@
+#include "symbol_cache.h"
+
+#if defined(__linux__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#endif
+
+namespace {
+
+size_t align8(size_t size) {
+  return (size + 7) & ~(size_t)7;
+}
+
+}  // namespace
+
+void symbol_cache::writer::add_strings(
+    uint32_t id,
+    std::span<const std::string_view> strings) {
+  std::vector<uint8_t> data;
+  for (std::string_view s : strings) {
+    data.insert(data.end(), s.begin(), s.end());
+    data.push_back(0);
+  }
+  sections_.emplace_back(id, std::move(data));
+}
+
+std::vector<std::string_view> symbol_cache::strings(uint32_t id) const {
+  std::vector<std::string_view> strings;
+  auto data = array<char>(id);
+  if (data.empty() || data.back() != 0) {
+    return strings;
+  }
+  for (const char* p = data.data(); p < data.data() + data.size();) {
+    size_t length = std::strlen(p);
+    strings.emplace_back(p, length);
+    p += length + 1;
+  }
+  return strings;
+}
+
+const symbol_cache::entry* symbol_cache::find(uint32_t id) const {
+  for (const entry& e : entries_) {
+    if (e.id == id) {
+      return &e;
+    }
+  }
+  return nullptr;
+}
+
+#if defined(__linux__)
+
+bool symbol_cache::writer::write(const std::string& path) const {
+  std::vector<entry> entries;
+  size_t offset = align8(sizeof(header) + sections_.size() * sizeof(entry));
+  for (const auto& [id, data] : sections_) {
+    entries.push_back(entry{
+        .id = id,
+        .reserved = 0,
+        .offset = offset,
+        .size = data.size(),
+    });
+    offset = align8(offset + data.size());
+  }
+  header h{};
+  std::memcpy(h.magic, kMagic, sizeof(kMagic));
+  h.version = kVersion;
+  h.count = (uint32_t)entries.size();
+
+  std::error_code ec;
+  std::filesystem::create_directories(
+      std::filesystem::path(path).parent_path(), ec);
+  std::string temporary = path + ".XXXXXX";
+  int fd = ::mkstemp(temporary.data());
+  if (fd < 0) {
+    return false;
+  }
+  ::fchmod(fd, 0644);  // readable by tracers of other users
+  FILE* file = ::fdopen(fd, "wb");
+  if (!file) {
+    ::close(fd);
+    ::unlink(temporary.c_str());
+    return false;
+  }
+  static constexpr uint8_t kPadding[8] = {};
+  bool ok = std::fwrite(&h, sizeof(h), 1, file) == 1;
+  ok = ok && std::fwrite(entries.data(), sizeof(entry), entries.size(),
+                         file) == entries.size();
+  size_t written = sizeof(h) + entries.size() * sizeof(entry);
+  for (size_t i = 0; ok && i < entries.size(); ++i) {
+    const auto& data = sections_[i].second;
+    ok = std::fwrite(kPadding, 1, entries[i].offset - written, file) ==
+             entries[i].offset - written &&
+         (data.empty() ||
+          std::fwrite(data.data(), 1, data.size(), file) == data.size());
+    written = entries[i].offset + data.size();
+  }
+  ok = std::fclose(file) == 0 && ok;
+  // readers either see the old file or the complete new one
+  if (!ok || ::rename(temporary.c_str(), path.c_str()) != 0) {
+    ::unlink(temporary.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::string symbol_cache::path(std::string_view build_id) {
+  if (build_id.empty()) {
+    return {};
+  }
+  std::string directory;
+  if (const char* cache = std::getenv("XDG_CACHE_HOME"); cache && *cache) {
+    directory = cache;
+  } else if (const char* home = std::getenv("HOME"); home && *home) {
+    directory = std::string(home) + "/.cache";
+  } else {
+    return {};
+  }
+  return directory + "/livetrace/" + std::string(build_id) + ".sym";
+}
+
+// The entries are checked against the file size once here, so array() only
+// needs to look them up.
+std::unique_ptr<symbol_cache> symbol_cache::open(const std::string& path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return nullptr;
+  }
+  struct stat st {};
+  void* data = MAP_FAILED;
+  if (::fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(header)) {
+    data = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  }
+  ::close(fd);
+  if (data == MAP_FAILED) {
+    return nullptr;
+  }
+
+  std::unique_ptr<symbol_cache> cache(new symbol_cache());
+  cache->data_ = (const uint8_t*)data;
+  cache->size_ = (size_t)st.st_size;
+  const auto* h = (const header*)cache->data_;
+  if (std::memcmp(h->magic, kMagic, sizeof(kMagic)) != 0 ||
+      h->version != kVersion ||
+      h->count > (cache->size_ - sizeof(header)) / sizeof(entry)) {
+    return nullptr;
+  }
+  cache->entries_ = {(const entry*)(cache->data_ + sizeof(header)), h->count};
+  for (const entry& e : cache->entries_) {
+    if (e.offset % 8 != 0 || e.offset > cache->size_ ||
+        e.size > cache->size_ - e.offset) {
+      return nullptr;
+    }
+  }
+  return cache;
+}
+
+symbol_cache::~symbol_cache() {
+  if (data_) {
+    ::munmap((void*)data_, size_);
+  }
+}
+
+#endif  // defined(__linux__)
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Decoded symbols of one module in a flat file, so the next attach to the
+// same build maps them instead of decoding its symbol table and DWARF again.
+// The file is a list of arrays tagged with an id; tables write their arrays
+// as they are laid out in memory and look up in the mapping after load, so
+// the cache must outlive them. Files are
+// replaced atomically and only ever mapped read-only, so several tracers can
+// share them.
+class symbol_cache {
+ public:
+  enum id : uint32_t {
+    kFunctionAddresses = 1,
+    kFunctionSizes,
+    kFunctionNames,
+    kLineAddresses,
+    kLineBlocks,
+    kLineDeltas,
+    kLineRows,
+    kLineFiles,
+    kInlineStarts,
+    kInlineEnds,
+    kInlineRanges,
+    kInlineCalls,
+    kInlineNames,
+  };
+
+  // Collects arrays in memory and writes them out in one go.
+  class writer {
+   public:
+    template <typename T>
+    void add(uint32_t id, std::span<const T> values) {
+      static_assert(std::is_trivially_copyable_v<T>);
+      std::vector<uint8_t> data(values.size_bytes());
+      if (!data.empty()) {
+        std::memcpy(data.data(), values.data(), data.size());
+      }
+      sections_.emplace_back(id, std::move(data));
+    }
+    // Strings are stored back to back, each followed by a terminator.
+    void add_strings(uint32_t id, std::span<const std::string_view> strings);
+
+    // Writes to a temporary file next to |path| and renames it over |path|.
+    bool write(const std::string& path) const;
+
+   private:
+    std::vector<std::pair<uint32_t, std::vector<uint8_t>>> sections_;
+  };
+
+  // Path of the cache file of the module with |build_id|, under
+  // $XDG_CACHE_HOME/livetrace or ~/.cache/livetrace. Empty if |build_id| is
+  // empty or there is no home directory.
+  static std::string path(std::string_view build_id);
+
+  // Maps the cache file at |path|. Returns nullptr if it does not exist or
+  // was written by another version.
+  static std::unique_ptr<symbol_cache> open(const std::string& path);
+  ~symbol_cache();
+
+  symbol_cache(const symbol_cache&) = delete;
+  symbol_cache& operator=(const symbol_cache&) = delete;
+
+  bool contains(uint32_t id) const { return find(id) != nullptr; }
+
+  // Array stored under |id|, empty if there is none.
+  template <typename T>
+  std::span<const T> array(uint32_t id) const {
+    static_assert(std::is_trivially_copyable_v<T>);
+    const entry* e = find(id);
+    if (!e || e->size % sizeof(T) != 0 || e->offset % alignof(T) != 0) {
+      return {};
+    }
+    return {(const T*)(data_ + e->offset), (size_t)(e->size / sizeof(T))};
+  }
+  // Strings stored under |id| by add_strings(). The views are terminated and
+  // stay valid as long as the cache.
+  std::vector<std::string_view> strings(uint32_t id) const;
+
+ private:
+  static constexpr char kMagic[8] = {'l', 't', 's', 'y', 'm', 'b', 'o', 'l'};
+  // bumped whenever a table changes what it stores
+  static constexpr uint32_t kVersion = 1;
+
+  struct header {
+    char magic[8];
+    uint32_t version;
+    uint32_t count;  // of entries following the header
+  };
+  struct entry {
+    uint32_t id;
+    uint32_t reserved;
+    uint64_t offset;  // from the start of the file, 8-byte aligned
+    uint64_t size;
+  };
+
+  symbol_cache() = default;
+  const entry* find(uint32_t id) const;
+
+  const uint8_t* data_ = nullptr;
+  size_t size_ = 0;
+  std::span<const entry> entries_;
+};
@@ -0,0 +1,326 @@
+// Checks the pieces of the Linux symbolizer that are easy to get subtly
+// wrong against small fixtures built in memory: line programs, program
+// headers as lld and ld lay them out, and /proc/<pid>/maps texts.
+
+#include <elf.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "elf_symbolizer.h"
+#include "line_table.h"
+#include "module_map.h"
+
+namespace {
+
+int failures = 0;
+
+#define CHECK(condition)                                               \
+  do {                                                                 \
+    if (!(condition)) {                                                \
+      std::fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__,      \
+                   __LINE__, #condition);                              \
+      failures++;                                                      \
+    }                                                                  \
+  } while (0)
+
+// A DWARF 4 line program with one file, "a.c".
+class line_program {
+ public:
+  void set_address(uint64_t address) {
+    extended(2, 9);
+    for (int i = 0; i < 8; ++i) {
+      program_.push_back((uint8_t)(address >> (i * 8)));
+    }
+  }
+  void advance_pc(uint64_t delta) {
+    program_.push_back(2);
+    uleb(delta);
+  }
+  void advance_line(int64_t delta) {
+    program_.push_back(3);
+    sleb(delta);
+  }
+  void copy() { program_.push_back(1); }
+  void end_sequence() { extended(1, 1); }
+
+  std::vector<uint8_t> unit() const {
+    std::vector<uint8_t> header = {
+        1,                       // minimum_instruction_length
+        1,                       // maximum_operations_per_instruction
+        1,                       // default_is_stmt
+        (uint8_t)-5,             // line_base
+        14,                      // line_range
+        13,                      // opcode_base
+        0, 1, 1, 1, 1, 0, 0, 0, 1, 0, 0, 1,  // standard_opcode_lengths
+        0,                       // no include_directories
+        'a', '.', 'c', 0, 0, 0, 0,  // file_names
+        0,
+    };
+    std::vector<uint8_t> unit;
+    auto put32 = [&](uint32_t value) {
+      for (int i = 0; i < 4; ++i) {
+        unit.push_back((uint8_t)(value >> (i * 8)));
+      }
+    };
+    put32((uint32_t)(2 + 4 + header.size() + program_.size()));
+    unit.push_back(4);  // version
+    unit.push_back(0);
+    put32((uint32_t)header.size());
+    unit.insert(unit.end(), header.begin(), header.end());
+    unit.insert(unit.end(), program_.begin(), program_.end());
+    return unit;
+  }
+
+ private:
+  void extended(uint8_t opcode, uint8_t length) {
+    program_.push_back(0);
+    program_.push_back(length);
+    program_.push_back(opcode);
+  }
+  void uleb(uint64_t value) {
+    do {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      program_.push_back(byte | (value ? 0x80 : 0));
+    } while (value);
+  }
+  void sleb(int64_t value) {
+    while (true) {
+      uint8_t byte = value & 0x7f;
+      value >>= 7;
+      if ((value == 0 && !(byte & 0x40)) || (value == -1 && (byte & 0x40))) {
+        program_.push_back(byte);
+        return;
+      }
+      program_.push_back(byte | 0x80);
+    }
+  }
+
+  std::vector<uint8_t> program_;
+};
+
+// Two functions back to back, each in a sequence of its own: line 10 at
+// 0x1000-0x1010, line 20 at 0x1010-0x1020.
+void add_sequence(line_program* p, uint64_t start, int line) {
+  p->set_address(start);
+  p->advance_line(line - 1);
+  p->copy();
+  p->advance_pc(0x10);
+  p->end_sequence();
+}
+
+void check_lines(const line_table& lines) {
+  std::string_view file;
+  uint32_t line = 0;
+  CHECK(!lines.find(0xfff, &file, &line));
+  CHECK(lines.find(0x1000, &file, &line) && line == 10 && file == "a.c");
+  CHECK(lines.find(0x100f, &file, &line) && line == 10);
+  // the end row of the first sequence shares the address
+  CHECK(lines.find(0x1010, &file, &line) && line == 20);
+  CHECK(lines.find(0x101f, &file, &line) && line == 20);
+  CHECK(!lines.find(0x1020, &file, &line));
+}
+
+void test_line_table() {
+  for (bool reversed : {false, true}) {
+    line_program program;
+    add_sequence(&program, reversed ? 0x1010 : 0x1000, reversed ? 20 : 10);
+    add_sequence(&program, reversed ? 0x1000 : 0x1010, reversed ? 10 : 20);
+    std::vector<uint8_t> unit = program.unit();
+
+    dwarf::sections sections{};
+    sections.line = unit;
+    line_table lines;
+    lines.build(sections);
+    check_lines(lines);
+  }
+}
+
+struct load_segment {
+  uint64_t offset;
+  uint64_t address;
+  uint64_t size;
+  uint32_t flags;
+};
+
+// Writes an ELF file with nothing but |segments| to a temporary file.
+std::string write_elf(const std::vector<load_segment>& segments) {
+  std::vector<uint8_t> data(sizeof(Elf64_Ehdr) +
+                            segments.size() * sizeof(Elf64_Phdr));
+  Elf64_Ehdr ehdr{};
+  std::memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+  ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+  ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+  ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+  ehdr.e_type = ET_DYN;
+  ehdr.e_machine = EM_X86_64;
+  ehdr.e_version = EV_CURRENT;
+  ehdr.e_phoff = sizeof(Elf64_Ehdr);
+  ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+  ehdr.e_phentsize = sizeof(Elf64_Phdr);
+  ehdr.e_phnum = (uint16_t)segments.size();
+  std::memcpy(data.data(), &ehdr, sizeof(ehdr));
+  for (size_t i = 0; i < segments.size(); ++i) {
+    Elf64_Phdr phdr{};
+    phdr.p_type = PT_LOAD;
+    phdr.p_flags = segments[i].flags;
+    phdr.p_offset = segments[i].offset;
+    phdr.p_vaddr = segments[i].address;
+    phdr.p_paddr = segments[i].address;
+    phdr.p_filesz = segments[i].size;
+    phdr.p_memsz = segments[i].size;
+    phdr.p_align = 0x1000;
+    std::memcpy(data.data() + ehdr.e_phoff + i * sizeof(phdr), &phdr,
+                sizeof(phdr));
+  }
+
+  char path[] = "/tmp/livetrace_test_XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0 || write(fd, data.data(), data.size()) != (ssize_t)data.size()) {
+    std::perror("livetrace_test");
+    std::exit(1);
+  }
+  close(fd);
+  return path;
+}
+
+void test_segment_delta() {
+  int64_t page = sysconf(_SC_PAGESIZE);
+  if (page != 0x1000) {
+    std::fprintf(stderr, "segment_delta: skipped, pages are not 4k\n");
+    return;
+  }
+
+  // ld: every segment starts on a page of its own in the file
+  std::string path = write_elf({
+      {0x0, 0x0, 0x5e0, PF_R},
+      {0x1000, 0x1000, 0x16d, PF_R | PF_X},
+      {0x2000, 0x2000, 0x11c, PF_R},
+      {0x2e00, 0x3e00, 0x210, PF_R | PF_W},
+  });
+  auto module = elf_module::open(path);
+  unlink(path.c_str());
+  CHECK(module);
+  if (module) {
+    int64_t delta = -1;
+    CHECK(module->segment_delta(0x1000, &delta) && delta == 0);
+    CHECK(module->segment_delta(0x2000, &delta) && delta == 0);
+    CHECK(!module->segment_delta(0x3000, &delta));
+  }
+
+  // lld: segments follow each other in the file without padding, so the
+  // text starts in the page the read-only data ends in
+  path = write_elf({
+      {0x0, 0x0, 0x5e4, PF_R},
+      {0x5f0, 0x15f0, 0x210, PF_R | PF_X},
+      {0x800, 0x2800, 0x80, PF_R | PF_W},
+  });
+  module = elf_module::open(path);
+  unlink(path.c_str());
+  CHECK(module);
+  if (module) {
+    // the executable mapping at offset 0 is the text, mapped at 0x1000
+    int64_t delta = -1;
+    CHECK(module->segment_delta(0x0, &delta) && delta == 0x1000);
+    CHECK(!module->segment_delta(0x5f0, &delta));
+  }
+}
+
+constexpr std::string_view kMaps =
+    "55d0c0a00000-55d0c0a01000 r--p 00000000 fe:00 1001 /usr/bin/app\n"
+    "55d0c0a01000-55d0c0a05000 r-xp 00001000 fe:00 1001 /usr/bin/app\n"
+    "7f0000000000-7f0000020000 r-xp 00000000 fe:00 2002 /usr/lib/libx.so\n"
+    "7ffd00000000-7ffd00021000 rw-p 00000000 00:00 0    [stack]\n";
+
+std::string replace(std::string_view text, std::string_view from,
+                    std::string_view to) {
+  std::string result(text);
+  result.replace(result.find(from), from.size(), to);
+  return result;
+}
+
+void test_module_map() {
+  module_map maps;
+  CHECK(maps.update(std::string(kMaps)));
+  std::vector<module_map::mapping> added = maps.take_added();
+  CHECK(added.size() == 2);  // executable mappings only
+  uint32_t generation = added.empty() ? 0 : added[0].generation;
+  CHECK(generation != 0);
+  CHECK(!maps.update(std::string(kMaps)));
+
+  // replaced by a package upgrade, the file of the mapping is still there
+  std::string text =
+      replace(kMaps, "/usr/lib/libx.so\n", "/usr/lib/libx.so (deleted)\n");
+  CHECK(maps.update(text));
+  CHECK(maps.take_added().empty());
+  maps.for_each([&](const module_map::mapping& m) {
+    CHECK(m.generation == generation);
+    if (m.inode == 2002) {
+      CHECK(m.path == "/usr/lib/libx.so");
+      CHECK(m.deleted);
+      CHECK(m.dev == (0xfeull << 32));
+    }
+  });
+
+  // mprotect of a page in the middle splits the mapping in three
+  text = replace(
+      text, "7f0000000000-7f0000020000 r-xp 00000000",
+      "7f0000000000-7f0000010000 r-xp 00000000 fe:00 2002 /usr/lib/libx.so "
+      "(deleted)\n"
+      "7f0000010000-7f0000011000 rwxp 00010000 fe:00 2002 /usr/lib/libx.so "
+      "(deleted)\n"
+      "7f0000011000-7f0000020000 r-xp 00011000");
+  CHECK(maps.update(text));
+  CHECK(maps.take_added().empty());
+  int mappings = 0;
+  maps.for_each([&](const module_map::mapping& m) {
+    CHECK(m.generation == generation);
+    mappings++;
+  });
+  CHECK(mappings == 4);
+
+  // another file loaded at the same place is new
+  text = std::string(kMaps);
+  text = replace(text, "fe:00 2002 /usr/lib/libx.so", "fe:00 3003 /usr/lib/liby.so");
+  CHECK(maps.update(text));
+  added = maps.take_added();
+  CHECK(added.size() == 1);
+  if (!added.empty()) {
+    CHECK(added[0].inode == 3003);
+    CHECK(added[0].generation > generation);
+  }
+
+  // JIT code in anonymous mappings is versioned by jit_symbols, the bounds
+  // change whenever the JIT grows its code space or flips it writable
+  for (std::string_view anonymous :
+       {"7f1000000000-7f1000010000 r-xp 00000000 00:00 0\n",
+        "7f1000000000-7f1000020000 rwxp 00000000 00:00 0\n",
+        "7f1000008000-7f1000020000 r-xp 00000000 00:00 0\n"}) {
+    CHECK(maps.update(text + std::string(anonymous)));
+    CHECK(maps.take_added().empty());
+    maps.for_each([&](const module_map::mapping& m) {
+      CHECK(m.inode != 0 || m.generation == 0);
+    });
+  }
+}
+
+}  // namespace
+
+int main() {
+  test_line_table();
+  test_segment_delta();
+  test_module_map();
+  if (failures) {
+    std::fprintf(stderr, "%d checks failed\n", failures);
+    return 1;
+  }
+  std::printf("all checks passed\n");
+  return 0;
+}
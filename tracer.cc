@@ -1,11 +1,19 @@
 #include "tracer.h"
 
+#include "backend.h"
+
+#if defined(_WIN32)
 #include <wil/result.h>
-#include <wrl/implements.h>
 #include <tlhelp32.h>
 #include <winrt/base.h>
-#include <dbghelp.h>
+#elif defined(__linux__)
+#include <dirent.h>
+
+#include <filesystem>
+#include <fstream>
+#endif
 
+#include <algorithm>
 #include <iostream>
 #include <sstream>
 #include <cassert>
@@ -14,20 +22,42 @@
 #include <set>
 #include <queue>
 
-#pragma comment(lib, "dbgeng.lib")
-
 namespace {
 
+// how often the symbolizer thread asks the backend for new mappings
+constexpr auto kModulePollInterval = std::chrono::milliseconds(500);
+
+#if defined(_WIN32)
 std::string narrow(const std::wstring& str) {
   return winrt::to_string(str);
 }
 std::wstring widen(const std::string& str) {
   return (std::wstring)winrt::to_hstring(str);
 }
+#endif
+
+std::unique_ptr<tracer::backend> create_backend() {
+#if defined(_WIN32)
+  return create_dbgeng_backend();
+#elif defined(__linux__)
+  return create_perf_backend();
+#endif
+}
+
+// Used when the default backend cannot attach, e.g. perf_event_open() denied
+// by perf_event_paranoid.
+std::unique_ptr<tracer::backend> create_fallback_backend() {
+#if defined(__linux__)
+  return create_ptrace_backend();
+#else
+  return nullptr;
+#endif
+}
 
 }  // namespace
 
 tracer::tracer() {
+  publish(thread_id_, config{});
 }
 
 tracer::~tracer() {
@@ -36,177 +66,577 @@ tracer::~tracer() {
 
 void tracer::worker_thread(int pid) {
   try {
-    wil::unique_process_handle handle(
-        ::OpenProcess(PROCESS_QUERY_LIMITED_INFORMATION, FALSE, pid));
-    if (!handle) {
-      throw std::domain_error("failed to OpenProcess().");
+    config config;
+    {
+      std::lock_guard lock(mutex_config_);
+      config = config_;
     }
-    wchar_t name[4096];
-    DWORD size = sizeof(name);
-    BOOL ret = ::QueryFullProcessImageName(handle.get(), 0, name, &size);
-    if (!ret) {
-      throw std::domain_error("failed to QueryFullProcessImageName().");
-    }
-    process_name_ = narrow(name);
-
-    ComPtr<IDebugClient8> debug_client;
-    ComPtr<IDebugControl7> debug_control;
-    ComPtr<IDebugSystemObjects4> debug_system_objects;
-    ComPtr<IDebugSymbols5> debug_symbols;
-
-    HRESULT hr = ::DebugCreate(__uuidof(IDebugClient8), &debug_client);
-    THROW_IF_FAILED(hr);
-
-    hr = debug_client.As(&debug_control);
-    THROW_IF_FAILED(hr);
+    window_.reset(config.window_retention, config.window);
+    decay_.reset(config.half_life);
 
-    hr = debug_client.As(&debug_system_objects);
-    THROW_IF_FAILED(hr);
-
-    hr = debug_client.As(&debug_symbols);
-    THROW_IF_FAILED(hr);
-
-    bool attached = false;
-    hr = debug_client->AttachProcess(
-        0ull, pid,
-        DEBUG_ATTACH_NONINVASIVE | DEBUG_ATTACH_NONINVASIVE_NO_SUSPEND);
-    THROW_IF_FAILED(hr);
-
-    hr = debug_control->WaitForEvent(DEBUG_WAIT_DEFAULT, INFINITE);
-    THROW_IF_FAILED(hr);
-    attached = true;
+    try {
+      backend_->attach(pid, config);
+    } catch (std::exception&) {
+      backend_ = create_fallback_backend();
+      if (!backend_) {
+        throw;
+      }
+      backend_->attach(pid, config);
+    }
+    process_name_ = backend_->process_name();
+    symbolizer_exit_ = false;
+    symbolizer_ = std::thread(&tracer::symbolizer_thread, this);
 
     // main loop
     state_ = running;
+    scheduler_.reset(config.sample_frequency, config.sample_jitter);
+    rate_start_ = scheduler::clock::now();
+    std::unordered_map<uint32_t, std::vector<stack_frame>> last_stack_frames;
     while (!exit_) {
-      std::this_thread::sleep_for(std::chrono::milliseconds(1));
-
-      if (state_ == paused) {
-        continue;
+      auto last = config;
+      {
+        std::lock_guard lock(mutex_config_);
+        config = config_;
+      }
+      if (config.sample_frequency != scheduler_.frequency() ||
+          config.sample_jitter != scheduler_.jitter()) {
+        scheduler_.reset(config.sample_frequency, config.sample_jitter);
+      }
+      if (config.sample_frequency != last.sample_frequency) {
+        backend_->configure(config);
+      }
+      if (config.window != last.window ||
+          config.window_retention != last.window_retention) {
+        window_.reset(config.window_retention, config.window);
+      }
+      if (config.half_life != last.half_life) {
+        decay_.reset(config.half_life);
       }
+      auto now = scheduler_.wait();
+      apply_symbols();
 
-      ULONG total_thread_count = 0, largest_process = 0;
-      ret = debug_system_objects->GetTotalNumberThreads(&total_thread_count,
-                                                        &largest_process);
-      if (FAILED(ret)) {
+      if (state_ == paused) {
+        backend_->idle();
+        if (view_requested_.exchange(false)) {
+          publish(thread_id_, config);
+        }
         continue;
       }
 
+      // other threads are captured in full only in all threads mode
+      uint32_t thread_id = thread_id_;
+      frame_budget budget{
+          .thread_id = thread_id,
+          .max_frames = kMaxStackFrames,
+          .all_threads = config.all_threads,
+          .remaining = config.all_threads ? config.frame_budget : 0,
+      };
       std::vector<thread> threads;
-      for (int i = 0; i < (int)total_thread_count; ++i) {
-        ret = debug_system_objects->SetCurrentThreadId(i);
-        if (FAILED(ret)) {
-          continue;
-        }
+      std::vector<thread_sample> samples;
+      backend_->sample(&budget, &threads, &samples);
 
-        // set thread
-        ULONG thread_system_id = 0;
-        ret = debug_system_objects->GetCurrentThreadSystemId(&thread_system_id);
-        if (FAILED(ret)) {
-          continue;
-        }
+      for (const auto& thread : threads) {
+        lookup(thread.instruction_offset);
+      }
 
-        // get cycles
-        wil::unique_handle handle(
-            ::OpenThread(THREAD_QUERY_INFORMATION, FALSE, thread_system_id));
-        unsigned long long cycles = 0;
-        ::QueryThreadCycleTime(handle.get(), &cycles);
-
-        // capture stackframe
-        std::vector<stack_frame> sf;
-        if (thread_system_id == thread_id_) {
-          sf = capture_stack_frames(kMaxStackFrames, debug_control.Get(), debug_symbols.Get());
-        } else {
-          sf =  capture_stack_frames(1, debug_control.Get(), debug_symbols.Get());
+      uint64_t second = std::chrono::duration_cast<std::chrono::seconds>(
+                            now.time_since_epoch())
+                            .count();
+      double seconds =
+          std::chrono::duration<double>(now.time_since_epoch()).count();
+      std::vector<uint64_t> offsets;
+      for (auto& sample : samples) {
+        // outer frames shared with the previous sample are already resolved
+        auto& last = last_stack_frames[sample.id];
+        auto& sfs = sample.stack_frames;
+        size_t shared = 0;
+        while (shared < sfs.size() && shared < last.size()) {
+          const auto& a = sfs[sfs.size() - shared - 1];
+          const auto& b = last[last.size() - shared - 1];
+          if (a.instruction_offset != b.instruction_offset ||
+              a.frame_offset != b.frame_offset || !b.ip) {
+            break;
+          }
+          shared++;
+        }
+        for (size_t i = 0; i < sfs.size(); ++i) {
+          if (i < sfs.size() - shared) {
+            sfs[i].ip = lookup(sfs[i].instruction_offset);
+          } else {
+            sfs[i].ip = last[i - sfs.size() + last.size()].ip;
+          }
         }
+        last = sfs;
 
-        if (!sf.empty()) {
-          threads.push_back(thread{
-              .id = thread_system_id,
-              .cycles = cycles,
-              .instruction_offset = sf[0].instruction_offset,
-          });
+        offsets.clear();
+        for (const auto& sf : sample.stack_frames) {
+          offsets.push_back(sf.instruction_offset);
         }
 
-        if (thread_system_id == thread_id_) {
-          // capture all stackframes for selected thread
-          std::lock_guard lock(mutex_serialize_);
-          if (!sf.empty()) {
-            for (const auto& sf : sf) {
-              inclusive_[thread_id_][sf.instruction_offset]++;
+        if (!offsets.empty() && max_entries_ > 0) {
+          add_heavy_hitters(sample.id, offsets);
+        } else if (!offsets.empty()) {
+          uint32_t id = stacks_.intern(offsets);
+          if (id == rollup_keys_.size()) {
+            rollup_keys_.push_back(stack_rollup_keys(offsets));
+            if (!rollup_keys_.back().resolved) {
+              pending_stacks_.push_back(id);
             }
-            exclusive_[thread_id_][sf.front().instruction_offset]++;
           }
-          stack_frame_ = std::move(sf);
+          stack_counts_[sample.id][id]++;
+
+          // stacks waiting for symbols are rolled up once they resolve
+          if (rollup_keys_[id].resolved) {
+            add_rollups(rollup_keys_[id], 1, &functions_[sample.id],
+                        &lines_[sample.id]);
+          }
+          if (config.window > 0) {
+            window_.add(second, sample.id, id);
+          }
+          if (config.half_life > 0) {
+            decay_.add(seconds, sample.id, id);
+          }
+        }
+        if (sample.idle) {
+          idle_samples_++;
         }
+        if (sample.id == thread_id) {
+          stack_frame_ = std::move(sample.stack_frames);
+          timestamp_ = sample.timestamp;
+        }
+      }
+
+      // backends rotate the order threads are captured in
+      std::sort(threads.begin(), threads.end(),
+                [](const thread& a, const thread& b) { return a.id < b.id; });
+      std::erase_if(last_stack_frames, [&](const auto& entry) {
+        return !std::ranges::binary_search(threads, entry.first, {},
+                                           &thread::id);
+      });
+      // bounded mode keeps max_entries per live thread, summaries of exited
+      // threads go with them
+      for (auto* hitters : {&inclusive_hitters_, &exclusive_hitters_}) {
+        std::erase_if(*hitters, [&](const auto& entry) {
+          return !std::ranges::binary_search(threads, entry.first, {},
+                                             &thread::id);
+        });
       }
 
-      std::lock_guard lock(mutex_serialize_);
+      window_.advance(second);
+      if (max_entries_ > 0 && instruction_point_map_.size() > prune_at_) {
+        prune_instruction_points(last_stack_frames);
+      }
       counter_++;
+      overruns_ = scheduler_.overruns();
       threads_ = std::move(threads);
+
+      // measured rate, refreshed every second
+      rate_counter_++;
+      if (now - rate_start_ >= std::chrono::seconds(1)) {
+        sample_rate_ = rate_counter_ /
+                       std::chrono::duration<double>(now - rate_start_).count();
+        rate_start_ = now;
+        rate_counter_ = 0;
+      }
+
+      if (view_requested_.exchange(false)) {
+        publish(thread_id, config);
+      }
     }
 
     // finalize stacktrace
-    if (debug_client) {
-      debug_client->DetachProcesses();
-    }
+    stop_symbolizer();
+    apply_symbols();
+    backend_->detach();
     state_ = exited;
+    publish(thread_id_, config);
   } catch (std::exception& ex) {
+    stop_symbolizer();
+    if (backend_) {
+      backend_->detach();
+    }
     state_ = failed;
     err_ = ex.what();
   }
 }
 
-nlohmann::json tracer::snapshot() {
-  std::lock_guard lock(mutex_serialize_);
+// Runs on the sampling thread, the only one touching the aggregates. They
+// are only copied, into the buffers of a view no reader holds anymore, so
+// the sampler pays for copies and never for serialization. Symbols are
+// shared by every view until they change.
+void tracer::publish(uint32_t thread_id, const config& config) {
+  std::unique_ptr<view> v;
+  {
+    std::lock_guard lock(view_pool_->mutex);
+    if (!view_pool_->free.empty()) {
+      v = std::move(view_pool_->free.back());
+      view_pool_->free.pop_back();
+    }
+  }
+  if (!v) {
+    v = std::make_unique<view>();
+  }
+  v->version = ++view_version_;
+  v->options = config;
+  v->process_name = process_name_;
+  v->thread_id = thread_id;
+  v->samples = counter_;
+  v->sample_rate = sample_rate_;
+  v->overruns = overruns_;
+  v->idle_samples = idle_samples_;
+  v->pending_symbols = pending_symbols_;
+  v->timestamp = timestamp_;
+  v->stacks = stacks_.size();
+  v->threads = threads_;
+  v->stack_frames = stack_frame_;
 
-  nlohmann::json instruction_point_map;
-  for (const auto& [key, data] : instruction_point_map_) {
-    instruction_point_map[std::to_string(key)] = *data;
+  // decayed scores, the last |window| seconds, or everything since start;
+  // rollups are kept up to date only for the latter
+  bool decayed = config.half_life > 0;
+  bool derived = decayed || config.window > 0;
+  v->frames.clear();
+  v->counts.clear();
+  auto add = [&](uint32_t id, uint64_t count) {
+    auto stack = stacks_.stack(id);
+    v->frames.insert(v->frames.end(), stack.begin(), stack.end());
+    v->counts.emplace_back((uint32_t)stack.size(), count);
+  };
+  v->bounded = max_entries_ > 0;
+  v->inclusive_hitters.clear();
+  v->exclusive_hitters.clear();
+  if (v->bounded) {
+    auto copy_hitters = [&](const auto& hitters,
+                            std::vector<hitter>* entries) -> uint64_t {
+      auto it = hitters.find(thread_id);
+      if (it == hitters.end()) {
+        return 0;
+      }
+      it->second.for_each([&](uint64_t key, uint64_t count, uint64_t error) {
+        entries->push_back(hitter{key, count, error});
+      });
+      return it->second.min_count();
+    };
+    v->inclusive_bound =
+        copy_hitters(inclusive_hitters_, &v->inclusive_hitters);
+    v->exclusive_bound =
+        copy_hitters(exclusive_hitters_, &v->exclusive_hitters);
+  } else if (decayed) {
+    double seconds = std::chrono::duration<double>(
+                         scheduler::clock::now().time_since_epoch())
+                         .count();
+    decay_.for_each(thread_id, seconds, [&](uint32_t id, double score) {
+      // scores are in samples, below half a sample they are left out
+      if (uint64_t count = std::llround(score)) {
+        add(id, count);
+      }
+    });
+  } else if (config.window > 0) {
+    window_.sum(thread_id).for_each(add);
+  } else {
+    stack_counts_[thread_id].for_each(add);
   }
 
-  auto now = std::chrono::high_resolution_clock::now();
-  auto elapsed = now - start_;
-  auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+  v->functions.clear();
+  v->lines.clear();
+  auto copy_rollups = [&](const flat_map<uint64_t, rollup>& rollups,
+                          std::vector<rollup_entry>* entries) {
+    rollups.for_each([&](uint64_t key, const rollup& r) {
+      entries->push_back(rollup_entry{
+          .key = key,
+          .function_name = r.ip ? r.ip->function_name : 0,
+          .source_name = r.ip ? r.ip->source_name : 0,
+          .source_line = r.ip ? r.ip->source_line : 0,
+          .inclusive = r.inclusive,
+          .exclusive = r.exclusive,
+      });
+    });
+  };
+  if (!v->bounded && !derived) {
+    copy_rollups(functions_[thread_id], &v->functions);
+    copy_rollups(lines_[thread_id], &v->lines);
+  }
+
+  if (symbols_changed_) {
+    auto table = std::make_shared<symbol_table>();
+    instruction_point_map_.for_each(
+        [&](uint64_t key, const instruction_point* ip) {
+          if (ip->state == symbol_state::resolved) {
+            table->symbols.emplace_back(key, *ip);
+          }
+        });
+    table->names = names_->names();
+    table->names_storage = names_;
+    symbol_table_ = std::move(table);
+    symbols_changed_ = false;
+  }
+  v->symbols = symbol_table_;
+
+  // the deleter runs after the last reader is done with the view, two
+  // buffers are enough to never refill one a reader still holds
+  std::shared_ptr<const view> published(
+      v.release(), [pool = view_pool_](const view* done) {
+        std::unique_ptr<view> buffer(const_cast<view*>(done));
+        std::lock_guard lock(pool->mutex);
+        if (pool->free.size() < 2) {
+          pool->free.push_back(std::move(buffer));
+        }
+      });
+  view_.store(std::move(published));
+}
+
+// Runs on the thread calling snapshot(), with nothing but the view.
+nlohmann::json tracer::serialize(const view& v) {
+  const std::vector<std::string_view>& names = v.symbols->names;
+  flat_map<uint64_t, const instruction_point*> symbols;
+  for (const auto& [key, ip] : v.symbols->symbols) {
+    symbols[key] = &ip;
+  }
+  auto find = [&](uint64_t offset) -> const instruction_point* {
+    const auto* entry = symbols.find(offset);
+    return entry ? *entry : nullptr;
+  };
+
+  bool derived = v.options.half_life > 0 || v.options.window > 0;
+
+  // expand the stacks of the selected thread
+  flat_map<uint64_t, uint64_t> inclusive;
+  flat_map<uint64_t, uint64_t> exclusive;
+  call_tree tree;
+  flat_map<uint64_t, rollup> derived_functions;
+  flat_map<uint64_t, rollup> derived_lines;
+  generation_set seen;
+  std::vector<uint64_t> frames;
+  size_t at = 0;
+  for (auto [size, count] : v.counts) {
+    std::span<const uint64_t> stack(v.frames.data() + at, size);
+    at += size;
+    expand_inline_frames(stack, find, &frames);
+    // recursive frames count once per sample
+    seen.clear();
+    for (uint64_t frame : frames) {
+      if (seen.insert(frame)) {
+        inclusive[frame] += count;
+      }
+    }
+    exclusive[frames.front()] += count;
+
+    // outermost frame first
+    uint32_t node = call_tree::kRoot;
+    for (auto it = frames.rbegin(); it != frames.rend(); ++it) {
+      node = tree.child(node, *it);
+    }
+    tree.add(node, count);
+
+    if (derived) {
+      add_rollups(make_rollup_keys(frames, find, &seen), count,
+                  &derived_functions, &derived_lines);
+    }
+  }
+
+  nlohmann::json inclusive_error = nlohmann::json::object();
+  nlohmann::json exclusive_error = nlohmann::json::object();
+  nlohmann::json error_bound = nlohmann::json::object();
+  if (v.bounded) {
+    // counts overestimate by at most their error, untracked addresses
+    // occurred at most |error_bound| times
+    auto expand_hitters = [&](const std::vector<hitter>& hitters,
+                              flat_map<uint64_t, uint64_t>* counts,
+                              nlohmann::json* errors) {
+      for (const hitter& h : hitters) {
+        (*counts)[h.key] = h.count;
+        if (h.error) {
+          (*errors)[std::to_string(h.key)] = h.error;
+        }
+      }
+    };
+    expand_hitters(v.inclusive_hitters, &inclusive, &inclusive_error);
+    expand_hitters(v.exclusive_hitters, &exclusive, &exclusive_error);
+    error_bound = {
+        {"inclusive", v.inclusive_bound},
+        {"exclusive", v.exclusive_bound},
+    };
+  }
+
+  std::vector<rollup_entry> function_entries = v.functions;
+  std::vector<rollup_entry> line_entries = v.lines;
+  if (derived) {
+    auto to_entries = [](const flat_map<uint64_t, rollup>& rollups,
+                         std::vector<rollup_entry>* entries) {
+      rollups.for_each([&](uint64_t key, const rollup& r) {
+        entries->push_back(rollup_entry{
+            .key = key,
+            .function_name = r.ip ? r.ip->function_name : 0,
+            .source_name = r.ip ? r.ip->source_name : 0,
+            .source_line = r.ip ? r.ip->source_line : 0,
+            .inclusive = r.inclusive,
+            .exclusive = r.exclusive,
+        });
+      });
+    };
+    to_entries(derived_functions, &function_entries);
+    to_entries(derived_lines, &line_entries);
+  }
+  nlohmann::json functions = nlohmann::json::object();
+  for (const auto& r : function_entries) {
+    functions[std::to_string(r.key)] = {
+        {"function_name", names[r.function_name]},
+        {"inclusive", r.inclusive},
+        {"exclusive", r.exclusive},
+    };
+  }
+  nlohmann::json lines = nlohmann::json::array();
+  for (const auto& r : line_entries) {
+    lines.push_back({
+        {"source_name", names[r.source_name]},
+        {"source_line", r.source_line},
+        {"inclusive", r.inclusive},
+        {"exclusive", r.exclusive},
+    });
+  }
+
+  // inlined calls of the last stack show up as virtual frames
+  std::vector<stack_frame> stack_frames;
+  for (const auto& sf : v.stack_frames) {
+    const instruction_point* ip = find(sf.instruction_offset);
+    for (int i = 0; ip && i < ip->inline_depth; ++i) {
+      stack_frames.push_back(sf);
+      stack_frames.back().instruction_offset =
+          inline_offset(sf.instruction_offset, i);
+      stack_frames.back().is_virtual = true;
+    }
+    stack_frames.push_back(sf);
+  }
+
+  // per address counts are only sent for the addresses on display, the
+  // rollups and the call tree stand in for the rest; bounded mode has no
+  // rollups, but no more than max_entries addresses either
+  bool all_addresses = v.options.all_addresses || v.bounded;
+  seen.clear();
+  for (const auto& sf : stack_frames) {
+    seen.insert(sf.instruction_offset);
+  }
+  for (const auto& thread : v.threads) {
+    seen.insert(thread.instruction_offset);
+  }
+  // the tree names its frames through the symbols
+  generation_set named = seen;
+  for (const auto& node : tree.nodes()) {
+    named.insert(node.instruction_offset);
+  }
+  auto shown = [&](uint64_t key) { return all_addresses || seen.contains(key); };
+  nlohmann::json instruction_point_map = nlohmann::json::object();
+  for (const auto& [key, ip] : v.symbols->symbols) {
+    if (all_addresses || named.contains(key)) {
+      instruction_point_map[std::to_string(key)] = to_symbol(ip, names);
+    }
+  }
+  auto counts_json = [&](const flat_map<uint64_t, uint64_t>& counts) {
+    nlohmann::json json = nlohmann::json::object();
+    counts.for_each([&](uint64_t key, uint64_t count) {
+      if (shown(key)) {
+        json[std::to_string(key)] = count;
+      }
+    });
+    return json;
+  };
 
   nlohmann::json json = {
-      // summary
-      {"process_id", process_id_},
-      {"process_name", process_name_},
-      {"process_cpu_usage", monitor_.cpu_usage(process_id_)},
-      {"process_phys_mem_usage", monitor_.phys_mem_usage(process_id_)},
-      {"process_virt_mem_usage", monitor_.virt_mem_usage(process_id_)},
-      {"thread_id", thread_id_},
-      {"elapsed", elapsed_ms},
-      {"samples", counter_},
-      {"state", (int)state_},
+      {"version", v.version},
+      {"process_name", v.process_name},
+      {"thread_id", v.thread_id},
+      {"samples", v.samples},
+      {"sample_rate", v.sample_rate},
+      {"overruns", v.overruns},
+      {"idle_samples", v.idle_samples},
       // threads
-      {"threads", threads_},
+      {"threads", v.threads},
       // selected thread
       {"instruction_point_map", instruction_point_map},
-      {"stack_frame", stack_frame_},
-      {"inclusive", inclusive_[thread_id_]},
-      {"exclusive", exclusive_[thread_id_]},
+      {"pending_symbols", v.pending_symbols},
+      {"stack_frame", stack_frames},
+      {"timestamp", v.timestamp},
+      {"stacks", v.stacks},
+      {"inclusive", counts_json(inclusive)},
+      {"exclusive", counts_json(exclusive)},
+      {"call_tree", tree.nodes()},
+      {"functions", functions},
+      {"lines", lines},
   };
+  if (v.bounded) {
+    json["inclusive_error"] = inclusive_error;
+    json["exclusive_error"] = exclusive_error;
+    json["error_bound"] = error_bound;
+  }
+  return json;
+}
+
+// Serializes the last view published by the sampling thread and asks for a
+// new one, so the caller never waits for sampling and the sampler never
+// waits for the caller.
+nlohmann::json tracer::snapshot() {
+  view_requested_ = true;
+  std::shared_ptr<const view> view = view_.load();
+  nlohmann::json json = view ? serialize(*view) : nlohmann::json::object();
+
+  auto now = std::chrono::high_resolution_clock::now();
+  auto elapsed = now - start_;
+  auto elapsed_ms = std::chrono::duration_cast<std::chrono::milliseconds>(elapsed).count();
+
+  // summary
+  json["process_id"] = process_id_;
+  json["process_cpu_usage"] = monitor_.cpu_usage(process_id_);
+  json["process_phys_mem_usage"] = monitor_.phys_mem_usage(process_id_);
+  json["process_virt_mem_usage"] = monitor_.virt_mem_usage(process_id_);
+  json["elapsed"] = elapsed_ms;
+  json["state"] = (int)state_;
+  {
+    std::lock_guard lock(mutex_config_);
+    json["config"] = config_;
+  }
   return json;
 }
 
 void tracer::start(uint32_t pid) {
   stop();
 
+  // the sampling thread is not running, so the aggregates can be reset here
+  {
+    std::lock_guard lock(mutex_config_);
+    max_entries_ = config_.max_entries;
+  }
   {
-    std::lock_guard lock(mutex_serialize_);
     state_ = state::preparing;
     start_ = std::chrono::high_resolution_clock::now();
     counter_ = 0;
+    rate_counter_ = 0;
+    sample_rate_ = 0;
+    overruns_ = 0;
+    idle_samples_ = 0;
+    timestamp_ = 0;
     process_id_ = pid;
     threads_.clear();
     stack_frame_.clear();
-    inclusive_.clear();
-    exclusive_.clear();
+    stacks_ = {};
+    stack_counts_.clear();
+    rollup_keys_.clear();
+    functions_.clear();
+    lines_.clear();
+    window_ = {};
+    decay_ = {};
+    prune_at_ = 4 * max_entries_;
+    inclusive_hitters_.clear();
+    exclusive_hitters_.clear();
     instruction_point_map_.clear();
+    instruction_points_.clear();
+    names_ = std::make_shared<string_table>();  // views keep the old one
+    symbols_changed_ = true;
+    function_ranges_.clear();
+    pending_stacks_.clear();
+    pending_symbols_ = 0;
+    publish(thread_id_, config{});
   }
 
+  backend_ = create_backend();
   exit_ = false;
   thread_ = std::thread(&tracer::worker_thread, this, pid);
 }
@@ -215,6 +645,13 @@ void tracer::select(uint32_t tid) {
   thread_id_ = tid;
 }
 
+void tracer::configure(const nlohmann::json& json) {
+  std::lock_guard lock(mutex_config_);
+  nlohmann::json merged = config_;
+  merged.update(json);
+  config_ = merged.get<config>();
+}
+
 void tracer::pause() {
   if (state_ == running) {
     state_ = paused;
@@ -233,94 +670,459 @@ void tracer::stop() {
   process_name_ = "";
 }
 
-bool tracer::lookup(stack_frame* stack_frame, IDebugSymbols5* debug_symbols_) {
-  {
-    std::lock_guard lock(mutex_serialize_);
-    auto it = instruction_point_map_.find(stack_frame->instruction_offset);
-    if (it != instruction_point_map_.end()) {
-      stack_frame->ip = it->second.get();
+// Called once per distinct stack, and again once symbols of its frames that
+// were pending arrive. |frames| has its inlined calls expanded already.
+// Frames that could not be symbolized count as their own function and have
+// no source line.
+template <typename F>
+tracer::rollup_keys tracer::make_rollup_keys(std::span<const uint64_t> frames,
+                                             F&& find,
+                                             generation_set* seen) {
+  rollup_keys keys{
+      .functions = {},
+      .lines = {},
+      .leaf_line = false,
+      .resolved = true,
+  };
+  std::vector<const instruction_point*> ips;
+  for (uint64_t offset : frames) {
+    const instruction_point* ip = find(offset);
+    if (ip && ip->state == symbol_state::pending) {
+      keys.resolved = false;
+    }
+    ips.push_back(ip && ip->state == symbol_state::resolved ? ip : nullptr);
+  }
+
+  seen->clear();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const instruction_point* ip = ips[i];
+    // inlined functions have no address of their own, they are told apart
+    // by name
+    uint64_t function = frames[i];
+    if (ip && ip->address) {
+      function = ip->address;
+    } else if (ip && ip->function_name) {
+      function = kInlinedFunction | ip->function_name;
+    }
+    if (seen->insert(function)) {
+      keys.functions.emplace_back(function, ip);
+    }
+  }
+
+  seen->clear();
+  for (size_t i = 0; i < frames.size(); ++i) {
+    const instruction_point* ip = ips[i];
+    if (!ip || !ip->source_name) {
+      continue;
+    }
+    uint64_t line = (uint64_t)ip->source_name << 32 | ip->source_line;
+    if (seen->insert(line)) {
+      keys.lines.emplace_back(line, ip);
+    }
+    if (i == 0) {
+      keys.leaf_line = true;
+    }
+  }
+  return keys;
+}
+
+tracer::rollup_keys tracer::stack_rollup_keys(
+    std::span<const uint64_t> stack) {
+  auto find = [this](uint64_t offset) { return this->find(offset); };
+  expand_inline_frames(stack, find, &expanded_);
+  return make_rollup_keys(expanded_, find, &seen_);
+}
+
+void tracer::add_rollups(const rollup_keys& keys,
+                         uint64_t count,
+                         flat_map<uint64_t, rollup>* functions,
+                         flat_map<uint64_t, rollup>* lines) {
+  for (const auto& [key, ip] : keys.functions) {
+    auto& function = (*functions)[key];
+    function.ip = ip;
+    function.inclusive += count;
+  }
+  (*functions)[keys.functions[0].first].exclusive += count;
+  for (const auto& [key, ip] : keys.lines) {
+    auto& line = (*lines)[key];
+    line.ip = ip;
+    line.inclusive += count;
+  }
+  if (keys.leaf_line) {
+    (*lines)[keys.lines[0].first].exclusive += count;
+  }
+}
+
+void tracer::add_heavy_hitters(uint32_t thread_id,
+                               std::span<const uint64_t> offsets) {
+  auto& inclusive =
+      inclusive_hitters_.try_emplace(thread_id, max_entries_).first->second;
+  auto& exclusive =
+      exclusive_hitters_.try_emplace(thread_id, max_entries_).first->second;
+  seen_.clear();
+  for (uint64_t offset : offsets) {
+    if (seen_.insert(offset)) {
+      inclusive.add(offset);
+    }
+  }
+  exclusive.add(offsets.front());
+}
+
+// Drops symbols of addresses that are neither tracked nor on a stack that
+// may still be spliced or shown.
+void tracer::prune_instruction_points(
+    const std::unordered_map<uint32_t, std::vector<stack_frame>>&
+        last_stack_frames) {
+  seen_.clear();
+  for (const auto* hitters : {&inclusive_hitters_, &exclusive_hitters_}) {
+    for (const auto& [thread_id, h] : *hitters) {
+      h.for_each([&](uint64_t key, uint64_t, uint64_t) { seen_.insert(key); });
+    }
+  }
+  for (const auto& [thread_id, stack_frames] : last_stack_frames) {
+    for (const auto& sf : stack_frames) {
+      seen_.insert(sf.instruction_offset);
+    }
+  }
+  for (const auto& sf : stack_frame_) {
+    seen_.insert(sf.instruction_offset);
+  }
+  // virtual frames go with the frame they were inlined into
+  uint64_t offset_mask = (1ull << kInlineShift) - 1;
+  instruction_point_map_.erase_if([&](uint64_t key, instruction_point* ip) {
+    if (!seen_.contains(key & offset_mask)) {
+      instruction_points_.free(ip);
       return true;
     }
+    return false;
+  });
+
+  // names and function ranges are rebuilt from what is left, so they stay
+  // within the budget however many functions the target runs through; views
+  // keep the old names
+  auto names = std::make_shared<string_table>();
+  std::vector<uint32_t> ids(names_->size(), UINT32_MAX);
+  ids[0] = 0;
+  auto remap = [&](uint32_t id) {
+    if (ids[id] == UINT32_MAX) {
+      ids[id] = names->intern(names_->name(id));
+    }
+    return ids[id];
+  };
+  std::vector<uint64_t> offsets;
+  instruction_point_map_.for_each([&](uint64_t key, instruction_point* ip) {
+    ip->function_name = remap(ip->function_name);
+    ip->source_name = remap(ip->source_name);
+    if (!(key >> kInlineShift)) {
+      offsets.push_back(key);
+    }
+  });
+  std::sort(offsets.begin(), offsets.end());
+  function_ranges_.erase_if(
+      [&](uint64_t start, uint64_t end, function_range& range) {
+        auto it = std::lower_bound(offsets.begin(), offsets.end(), start);
+        if (it == offsets.end() || *it >= end) {
+          return true;
+        }
+        range.function_name = remap(range.function_name);
+        return false;
+      });
+  names_ = std::move(names);
+  symbols_changed_ = true;
+  prune_at_ = 2 * std::max(instruction_point_map_.size(), 2 * max_entries_);
+}
+
+// Returns the cached instruction point of |instruction_offset|, or a pending
+// one that the symbolizer thread fills in later.
+tracer::instruction_point* tracer::lookup(uint64_t instruction_offset) {
+  if (auto* ip = instruction_point_map_.find(instruction_offset)) {
+    return *ip;
+  }
+
+  instruction_point* ip = instruction_points_.allocate();
+  ip->state = symbol_state::pending;
+  bool line_only = false;
+  if (const auto* range = function_ranges_.find(instruction_offset)) {
+    ip->function_name = range->function_name;
+    ip->address = range->address;
+    ip->displacement = instruction_offset - range->start;
+    ip->generation = range->generation;
+    line_only = true;
   }
+  instruction_point_map_[instruction_offset] = ip;
+  pending_symbols_++;
 
-  auto ip = std::make_unique<instruction_point>();
-
-  uint8_t buffer[1024];
-  ULONG needed = 0;
-  ULONG64 displacement = 0;
-  HRESULT hr;
-  hr = debug_symbols_->GetFunctionEntryByOffset(
-      stack_frame->instruction_offset, 0, buffer, sizeof(buffer), &needed);
-  if (SUCCEEDED(hr)) {
-    wchar_t name[1024 * 2]{};
-    ULONG name_size = 0;
-    hr = debug_symbols_->GetNameByOffsetWide(stack_frame->instruction_offset,
-                                             name, sizeof(name), &name_size,
-                                             &displacement);
-    if (SUCCEEDED(hr)) {
-      if (needed == sizeof(FPO_DATA)) {
-        const FPO_DATA* fpo_data = (FPO_DATA*)(buffer);
-        ip->address = fpo_data->ulOffStart;
-        // todo:
-      } else if (needed == sizeof(IMAGE_FUNCTION_ENTRY)) {
-        const IMAGE_FUNCTION_ENTRY* image_function_entry = (IMAGE_FUNCTION_ENTRY*)(buffer);
-        ip->function_name = narrow(name);
-        ip->address = image_function_entry->StartingAddress;
+  {
+    std::lock_guard lock(mutex_symbols_);
+    symbol_requests_.push_back(symbol_request{
+        .instruction_offset = instruction_offset,
+        .line_only = line_only,
+    });
+  }
+  cv_symbols_.notify_one();
+  return ip;
+}
+
+// Resolves addresses queued by lookup(), so a slow symbol server or a cold
+// module never delays a sample. Mappings are polled between lookups, so a
+// symbol resolved before a mapping change is always reported before it.
+void tracer::symbolizer_thread() {
+  std::vector<symbol_request> requests;
+  std::vector<mapped_range> ranges;
+  auto last_poll = std::chrono::steady_clock::now();
+  while (true) {
+    {
+      std::unique_lock lock(mutex_symbols_);
+      cv_symbols_.wait_for(lock, kModulePollInterval, [&] {
+        return symbolizer_exit_ || !symbol_requests_.empty();
+      });
+      if (symbolizer_exit_) {
+        return;
       }
-      ip->displacement = displacement;
+      requests.swap(symbol_requests_);
     }
-  } else {
-    return false;
+
+    auto now = std::chrono::steady_clock::now();
+    if (now - last_poll >= kModulePollInterval) {
+      last_poll = now;
+      backend_->poll_modules(&ranges);
+      if (!ranges.empty()) {
+        std::lock_guard lock(mutex_symbols_);
+        mapped_ranges_.insert(mapped_ranges_.end(), ranges.begin(),
+                              ranges.end());
+        ranges.clear();
+      }
+    }
+
+    for (const auto& request : requests) {
+      symbol_result result{
+          .instruction_offset = request.instruction_offset,
+          .line_only = request.line_only,
+          .found = false,
+          .value = {},
+      };
+      result.found =
+          request.line_only
+              ? backend_->lookup_line(request.instruction_offset,
+                                      &result.value)
+              : backend_->lookup(request.instruction_offset, &result.value);
+
+      std::lock_guard lock(mutex_symbols_);
+      symbol_results_.push_back(std::move(result));
+      if (symbolizer_exit_) {
+        return;
+      }
+    }
+    requests.clear();
   }
+}
 
-  ULONG line = 0;
-  wchar_t file_name[1024 * 2];
-  ULONG file_name_size = 0;
-  hr = debug_symbols_->GetLineByOffsetWide(stack_frame->instruction_offset,
-                                           &line, file_name, sizeof(file_name),
-                                           &file_name_size, &displacement);
-  if (SUCCEEDED(hr)) {
-    ip->source_name = narrow(file_name);
-    ip->source_line = line;
+void tracer::stop_symbolizer() {
+  if (!symbolizer_.joinable()) {
+    return;
+  }
+  {
+    std::lock_guard lock(mutex_symbols_);
+    symbolizer_exit_ = true;
   }
-  stack_frame->ip = ip.get();
+  cv_symbols_.notify_one();
+  symbolizer_.join();
+  symbol_requests_.clear();
+  symbol_results_.clear();
+  mapped_ranges_.clear();
+}
 
-  std::lock_guard lock(mutex_serialize_);
-  instruction_point_map_.try_emplace(stack_frame->instruction_offset, std::move(ip));
-  return true;
+// Stores what the symbolizer thread resolved since the previous round, then
+// drops what the target has mapped something else over since.
+void tracer::apply_symbols() {
+  std::vector<symbol_result> results;
+  std::vector<mapped_range> ranges;
+  {
+    std::lock_guard lock(mutex_symbols_);
+    results.swap(symbol_results_);
+    ranges.swap(mapped_ranges_);
+  }
+  if (results.empty() && ranges.empty()) {
+    return;
+  }
+  symbols_changed_ = true;
+
+  for (const auto& result : results) {
+    pending_symbols_--;
+    auto* entry = instruction_point_map_.find(result.instruction_offset);
+    if (!entry) {
+      continue;  // pruned meanwhile
+    }
+    instruction_point* ip = *entry;
+    const symbol& symbol = result.value;
+    ip->state = symbol_state::resolved;
+    if (result.found) {
+      if (!result.line_only) {
+        ip->generation = symbol.generation;  // inline frames share it
+      }
+      ip->source_name = names_->intern(symbol.source_name);
+      ip->source_line = (uint32_t)symbol.source_line;
+      add_inline_frames(result.instruction_offset, ip, symbol.inline_frames);
+    }
+    if (result.line_only) {
+      continue;
+    }
+    if (!result.found) {
+      ip->state = symbol_state::failed;
+      continue;
+    }
+    ip->function_name = names_->intern(symbol.function_name);
+    ip->address = symbol.address;
+    ip->displacement = symbol.displacement;
+    if (symbol.size) {
+      uint64_t start = result.instruction_offset - symbol.displacement;
+      function_ranges_.insert(start, start + symbol.size,
+                              function_range{
+                                  .function_name = ip->function_name,
+                                  .address = ip->address,
+                                  .start = start,
+                                  .generation = ip->generation,
+                              });
+    }
+  }
+  if (!ranges.empty()) {
+    invalidate_symbols(ranges);
+  }
+
+  // roll up the samples of stacks that are now fully symbolized
+  std::erase_if(pending_stacks_, [&](uint32_t id) {
+    rollup_keys keys = stack_rollup_keys(stacks_.stack(id));
+    if (!keys.resolved) {
+      return false;
+    }
+    rollup_keys_[id] = std::move(keys);
+    for (auto& [thread_id, counts] : stack_counts_) {
+      if (const uint64_t* count = counts.find(id)) {
+        add_rollups(rollup_keys_[id], *count, &functions_[thread_id],
+                    &lines_[thread_id]);
+      }
+    }
+    return true;
+  });
 }
 
-std::vector<tracer::stack_frame> tracer::capture_stack_frames(
-    int fill_frames,
-    IDebugControl7* debug_control,
-    IDebugSymbols5* debug_symbols) {
-  ULONG filled_frames{};
-  std::vector<DEBUG_STACK_FRAME_EX> frames(fill_frames);
+// Looks up again the symbols of older generations inside |ranges|, which the
+// target mapped since they were resolved. They are updated in place, as
+// stacks and rollups point at them; rollups already made keep their keys.
+void tracer::invalidate_symbols(const std::vector<mapped_range>& ranges) {
+  range_table<uint32_t> generations;
+  for (const auto& range : ranges) {
+    function_ranges_.erase(range.start, range.end);
+    if (!generations.insert(range.start, range.end, range.generation)) {
+      // mapped again between two polls, the newer one is listed last
+      generations.erase(range.start, range.end);
+      generations.insert(range.start, range.end, range.generation);
+    }
+  }
 
-  HRESULT hr = debug_control->GetStackTraceEx(
-      NULL, NULL, NULL, &frames.front(), (int)frames.size(), &filled_frames);
-  if (FAILED(hr)) {
-    return {};
+  std::vector<symbol_request> requests;
+  std::vector<uint64_t> inline_keys;
+  instruction_point_map_.for_each([&](uint64_t key, instruction_point* ip) {
+    // virtual frames are replaced along with the frame they belong to
+    if (key >> kInlineShift || ip->state == symbol_state::pending) {
+      return;
+    }
+    const uint32_t* generation = generations.find(key);
+    if (!generation || *generation <= ip->generation) {
+      return;
+    }
+    for (int i = 0; i < ip->inline_depth; ++i) {
+      inline_keys.push_back(inline_offset(key, i));
+    }
+    *ip = instruction_point{};
+    ip->state = symbol_state::pending;
+    requests.push_back(symbol_request{
+        .instruction_offset = key,
+        .line_only = false,
+    });
+  });
+  // the new symbol may inline other calls, or none
+  for (uint64_t key : inline_keys) {
+    if (auto* entry = instruction_point_map_.find(key)) {
+      instruction_points_.free(*entry);
+      instruction_point_map_.erase(key);
+    }
+  }
+  if (requests.empty()) {
+    return;
+  }
+  pending_symbols_ += requests.size();
+  {
+    std::lock_guard lock(mutex_symbols_);
+    symbol_requests_.insert(symbol_requests_.end(), requests.begin(),
+                            requests.end());
   }
+  cv_symbols_.notify_one();
+}
 
-  // lookup symbols
-  std::vector<stack_frame> sfs;
-  for (int i = 0; i < (int)filled_frames; ++i) {
-    stack_frame sf{};
-    sf.instruction_offset = frames[i].InstructionOffset;
-    sf.frame_offset = frames[i].FrameOffset;
-    sf.frame_number = frames[i].FrameNumber;
-    sf.return_offset = frames[i].ReturnOffset;
-    sf.stack_offset = frames[i].StackOffset;
-    sf.func_table_entry = frames[i].FuncTableEntry;
-    sf.is_virtual = frames[i].Virtual;
-    lookup(&sf, debug_symbols);
-    sfs.emplace_back(sf);
+// Stores the calls inlined at |instruction_offset| as instruction points of
+// their own, so stacks can be expanded with a virtual frame for each.
+void tracer::add_inline_frames(uint64_t instruction_offset,
+                               instruction_point* ip,
+                               const std::vector<inline_frame>& frames) {
+  int depth = (int)std::min(frames.size(), (size_t)kMaxInlineDepth);
+  ip->inline_depth = (uint8_t)depth;
+  for (int i = 0; i < depth; ++i) {
+    auto& frame = instruction_point_map_[inline_offset(instruction_offset, i)];
+    if (!frame) {
+      frame = instruction_points_.allocate();
+    }
+    *frame = instruction_point{
+        .state = symbol_state::resolved,
+        .inline_depth = 0,
+        .generation = ip->generation,
+        .function_name = names_->intern(frames[i].function_name),
+        .source_name = names_->intern(frames[i].source_name),
+        .source_line = (uint32_t)frames[i].source_line,
+        .address = 0,
+        .displacement = 0,
+    };
   }
+}
 
-  return sfs;
+// Copies |offsets| into |frames| with the virtual frames of inlined calls in
+// front of the frame they were inlined into.
+template <typename F>
+void tracer::expand_inline_frames(std::span<const uint64_t> offsets,
+                                  F&& find,
+                                  std::vector<uint64_t>* frames) {
+  frames->clear();
+  for (uint64_t offset : offsets) {
+    const instruction_point* ip = find(offset);
+    int depth = ip ? ip->inline_depth : 0;
+    for (int i = 0; i < depth; ++i) {
+      frames->push_back(inline_offset(offset, i));
+    }
+    frames->push_back(offset);
+  }
+}
+
+const tracer::instruction_point* tracer::find(
+    uint64_t instruction_offset) const {
+  const auto* entry = instruction_point_map_.find(instruction_offset);
+  return entry ? *entry : nullptr;
 }
 
+tracer::symbol tracer::to_symbol(const instruction_point& ip,
+                                 std::span<const std::string_view> names) {
+  return symbol{
+      .source_name = std::string(names[ip.source_name]),
+      .source_line = ip.source_line,
+      .function_name = std::string(names[ip.function_name]),
+      .address = ip.address,
+      .displacement = ip.displacement,
+      .size = 0,
+      .generation = ip.generation,
+      .inline_frames = {},
+  };
+}
+
+#if defined(_WIN32)
 std::optional<process::process_snapshot> process::snapshot() {
   wil::unique_tool_help_snapshot handle;
 
@@ -383,6 +1185,118 @@ wil::unique_process_handle process::start(
   return wil::unique_process_handle(pi.hProcess);
 }
 
+#elif defined(__linux__)
+
+namespace {
+
+std::vector<uint32_t> list_ids(const std::string& path) {
+  std::vector<uint32_t> ids;
+  DIR* dir = ::opendir(path.c_str());
+  if (!dir) {
+    return ids;
+  }
+  while (dirent* entry = ::readdir(dir)) {
+    if (entry->d_name[0] >= '0' && entry->d_name[0] <= '9') {
+      ids.push_back((uint32_t)std::stoul(entry->d_name));
+    }
+  }
+  ::closedir(dir);
+  std::sort(ids.begin(), ids.end());
+  return ids;
+}
+
+struct proc_stat {
+  uint32_t ppid;
+  uint32_t flags;
+  uint32_t priority;
+};
+
+// Fields of /proc/<pid>/stat, counted from 1. The command name in field 2
+// may contain spaces and parentheses, the fields after it are read from its
+// last ')'.
+bool read_proc_stat(const std::string& path, proc_stat* stat) {
+  std::ifstream ifs(path);
+  std::string text((std::istreambuf_iterator<char>(ifs)), {});
+  size_t pos = text.rfind(')');
+  if (pos == std::string::npos) {
+    return false;
+  }
+  unsigned ppid = 0, flags = 0;
+  long priority = 0;
+  if (std::sscanf(text.c_str() + pos + 1,
+                  " %*c %u %*d %*d %*d %*d %u %*u %*u %*u %*u %*u %*u %*d %*d "
+                  "%ld",
+                  &ppid, &flags, &priority) != 3) {
+    return false;
+  }
+  *stat = proc_stat{
+      .ppid = ppid,
+      .flags = flags,
+      .priority = (uint32_t)priority,
+  };
+  return true;
+}
+
+// Name of the executable like Windows lists it, the command name for
+// processes whose executable cannot be read.
+std::string read_exe(const std::string& path) {
+  std::error_code ec;
+  auto exe = std::filesystem::read_symlink(path + "/exe", ec);
+  if (!ec) {
+    return exe.filename().string();
+  }
+  std::ifstream ifs(path + "/comm");
+  std::string comm;
+  std::getline(ifs, comm);
+  return comm;
+}
+
+}  // namespace
+
+std::optional<process::process_snapshot> process::snapshot() {
+  std::vector<uint32_t> pids = list_ids("/proc");
+  if (pids.empty()) {
+    return {};
+  }
+
+  process_snapshot ret;
+  ret.timestamp =
+      std::chrono::high_resolution_clock::now().time_since_epoch().count();
+  for (uint32_t pid : pids) {
+    std::string path = "/proc/" + std::to_string(pid);
+    proc_stat stat;
+    if (!read_proc_stat(path + "/stat", &stat)) {
+      continue;  // exited meanwhile
+    }
+
+    process_info pi;
+    pi.id = pid;
+    pi.parent_process_id = stat.ppid;
+    pi.base_pri = stat.priority;
+    pi.flags = stat.flags;
+    pi.module_id = 0;
+    pi.exe = read_exe(path);
+    for (uint32_t tid : list_ids(path + "/task")) {
+      proc_stat thread_stat;
+      if (!read_proc_stat(path + "/task/" + std::to_string(tid) + "/stat",
+                          &thread_stat)) {
+        continue;
+      }
+      pi.threads.push_back(thread_info{
+          .id = tid,
+          .owner_process_id = pid,
+          .base_pri = stat.priority,
+          .delta_pri = thread_stat.priority - stat.priority,
+          .flags = thread_stat.flags,
+      });
+    }
+    ret.processes.emplace_back(std::move(pi));
+  }
+  return ret;
+}
+
+#endif
+
 std::optional<process::process_info> process::process_snapshot::find(
     const std::regex& re) const {
   for (const auto& process : processes) {
@@ -1,6 +1,8 @@
 #pragma once
 
 #include <atomic>
+#include <chrono>
+#include <condition_variable>
 #include <map>
 #include <unordered_map>
 #include <memory>
@@ -11,15 +13,27 @@
 #include <vector>
 #include <stack>
 #include <set>
+#include <span>
+#include <thread>
 
-#include <dbgeng.h>
-#include <wrl.h>
-using namespace Microsoft::WRL;
+#if defined(_WIN32)
 #include <wil/resource.h>
+#endif
 
 #include <json.hpp>
 
+#include "arena.h"
+#include "call_tree.h"
+#include "decayed_counts.h"
+#include "flat_map.h"
+#include "generation_set.h"
+#include "heavy_hitters.h"
 #include "monitor.h"
+#include "range_table.h"
+#include "scheduler.h"
+#include "sliding_window.h"
+#include "stack_table.h"
+#include "string_table.h"
 
 namespace nlohmann {
 
@@ -43,6 +57,17 @@ struct adl_serializer<std::map<uint64_t, T>> {
   }
 };
 
+template <typename T>
+struct adl_serializer<flat_map<uint64_t, T>> {
+  static void from_json(const json& j, flat_map<uint64_t, T>& map) {}
+  static void to_json(json& result, const flat_map<uint64_t, T>& map) {
+    result = json::object();
+    map.for_each([&](uint64_t key, const T& value) {
+      result[std::to_string(key)] = value;
+    });
+  }
+};
+
 }  // namespace nlohmann
 
 class tracer {
@@ -55,13 +80,47 @@ class tracer {
     uint32_t id;
     uint64_t cycles;
     uint64_t instruction_offset;
+    bool idle;  // has not run since the previous round
   };
-  struct instruction_point {
+  // a call the compiler inlined at an address
+  struct inline_frame {
+    std::string function_name;
+    std::string source_name;
+    uint64_t source_line;
+  };
+  // what a backend resolves an address to
+  struct symbol {
     std::string source_name;
     uint64_t source_line;
     std::string function_name;
     uint64_t address;
     uint64_t displacement;
+    uint64_t size;  // of the function in bytes, 0 if unknown
+    uint32_t generation;  // of the mapping it was found in
+    std::vector<inline_frame> inline_frames;  // innermost first
+  };
+  // an address range the target mapped, symbols of older generations inside
+  // it are stale
+  struct mapped_range {
+    uint64_t start;
+    uint64_t end;
+    uint32_t generation;
+  };
+  enum class symbol_state : uint8_t {
+    pending,   // queued for the symbolizer thread
+    resolved,
+    failed,    // the backend has no symbol for it
+  };
+  // a symbol as the tracer keeps it, with names interned in names_
+  struct instruction_point {
+    symbol_state state;
+    uint8_t inline_depth;  // virtual frames of inlined calls in front of it
+    uint32_t generation;   // of the mapping the function was found in
+    uint32_t function_name;
+    uint32_t source_name;
+    uint32_t source_line;
+    uint64_t address;
+    uint64_t displacement;
   };
   struct stack_frame {
     uint64_t instruction_offset;
@@ -73,6 +132,62 @@ class tracer {
     uint32_t frame_number;
     instruction_point* ip;
   };
+  struct thread_sample {
+    uint32_t id;
+    uint64_t timestamp;  // ns, steady_clock
+    bool idle;           // stack reused from the previous round
+    std::vector<stack_frame> stack_frames;
+  };
+  struct config {
+    double sample_frequency = 1000;  // Hz
+    double sample_jitter = 0;        // fraction of a period
+    bool all_threads = false;        // aggregate every thread, not only the
+                                     // selected one
+    int frame_budget = 4096;         // frames per round for other threads
+    int unwind_workers = 1;          // threads capturing stacks in parallel,
+                                     // applied on attach
+    bool skip_idle = false;          // reuse the last stack of threads that
+                                     // have not run, applied on attach
+    bool splice_stacks = true;       // reuse outer frames of the previous
+                                     // sample, applied on attach
+    int window = 0;                  // seconds the snapshot covers, 0 for
+                                     // everything since start
+    int window_retention = 60;       // seconds of samples kept for windows
+    double half_life = 0;            // seconds, snapshots show decayed
+                                     // counts instead when set
+    int max_entries = 0;             // addresses tracked per thread, 0 for
+                                     // no limit, applied on attach
+    bool all_addresses = false;      // snapshots carry symbols and counts of
+                                     // every address, not only of the shown
+                                     // stack, threads and call tree
+  };
+
+  // Decides how deep each thread is captured in one round. The selected
+  // thread is always captured |max_frames| deep, other threads share
+  // |remaining| frames and are only listed once it runs out. Shared by the
+  // workers of a backend.
+  struct frame_budget {
+    uint32_t thread_id;
+    int max_frames;
+    bool all_threads;
+    std::atomic<int> remaining;
+
+    int depth(uint32_t id) const {
+      return id == thread_id || remaining > 0 ? max_frames : 0;
+    }
+    // Whether samples of |id| are aggregated at all. Backends whose stacks
+    // come unwound already keep them all, the budget bounds unwinding.
+    bool captured(uint32_t id) const {
+      return id == thread_id || all_threads;
+    }
+    void consume(uint32_t id, size_t frames) {
+      if (id != thread_id) {
+        remaining -= (int)frames;
+      }
+    }
+  };
+
+  class backend;
 
   tracer();
   ~tracer();
@@ -81,36 +196,226 @@ class tracer {
   void select(uint32_t tid);
   void stop();
   void pause();
+  void configure(const nlohmann::json& json);
   nlohmann::json snapshot();
 
  private:
+  // samples attributed to one function or source line
+  struct rollup {
+    const instruction_point* ip;
+    uint64_t inclusive;
+    uint64_t exclusive;
+  };
+  // distinct functions and source lines of an interned stack, innermost
+  // frame first
+  struct rollup_keys {
+    std::vector<std::pair<uint64_t, const instruction_point*>> functions;
+    std::vector<std::pair<uint64_t, const instruction_point*>> lines;
+    bool leaf_line;  // lines[0] is the innermost frame
+    bool resolved;   // no frame is waiting for its symbol
+  };
+  // an address queued for the symbolizer thread, which only needs the source
+  // line when the function is already known
+  struct symbol_request {
+    uint64_t instruction_offset;
+    bool line_only;
+  };
+  struct symbol_result {
+    uint64_t instruction_offset;
+    bool line_only;
+    bool found;
+    symbol value;
+  };
+  // a rollup as published, with its names as ids
+  struct rollup_entry {
+    uint64_t key;
+    uint32_t function_name;
+    uint32_t source_name;
+    uint32_t source_line;
+    uint64_t inclusive;
+    uint64_t exclusive;
+  };
+  // a heavy hitter as published
+  struct hitter {
+    uint64_t key;
+    uint64_t count;
+    uint64_t error;
+  };
+  // What the sampling thread last published for snapshot(): its aggregates
+  // of the selected thread, copied as they are. snapshot() expands and
+  // serializes them on the calling thread. Immutable once published.
+  // resolved symbols as views share them, rebuilt by the sampling thread
+  // only after symbols changed
+  struct symbol_table {
+    // by instruction offset, virtual frames included
+    std::vector<std::pair<uint64_t, instruction_point>> symbols;
+    std::vector<std::string_view> names;  // by id
+    std::shared_ptr<const string_table> names_storage;  // owns |names|
+  };
+  struct view {
+    uint64_t version = 0;
+    config options;  // the sampler ran with
+    std::string process_name;
+    uint32_t thread_id = 0;
+    uint64_t samples = 0;
+    double sample_rate = 0;
+    uint64_t overruns = 0;
+    uint64_t idle_samples = 0;
+    uint64_t pending_symbols = 0;
+    uint64_t timestamp = 0;
+    size_t stacks = 0;
+    std::vector<thread> threads;
+    std::vector<stack_frame> stack_frames;  // last stack of the thread
+    // counted stacks, their frames back to back, with the number of frames
+    // and samples of each
+    std::vector<uint64_t> frames;
+    std::vector<std::pair<uint32_t, uint64_t>> counts;
+    // per address counts in bounded mode instead
+    bool bounded = false;
+    std::vector<hitter> inclusive_hitters;
+    std::vector<hitter> exclusive_hitters;
+    uint64_t inclusive_bound = 0;
+    uint64_t exclusive_bound = 0;
+    // rollups of all samples; window and decayed rollups are made from
+    // |counts| instead
+    std::vector<rollup_entry> functions;
+    std::vector<rollup_entry> lines;
+    std::shared_ptr<const symbol_table> symbols;
+  };
+  // views handed out return their buffers here once the last reader lets go
+  struct view_pool {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<view>> free;
+  };
+
+  // Inlined calls are kept as virtual frames keyed by the address they are
+  // at with their depth above the bits user space addresses use; keys stay
+  // below 2^53 so they survive as numbers in the web view.
+  static constexpr int kInlineShift = 48;
+  static constexpr int kMaxInlineDepth = 31;
+  static constexpr uint64_t kInlinedFunction = 1ull << 63;
+  static uint64_t inline_offset(uint64_t instruction_offset, int depth) {
+    return (uint64_t)(depth + 1) << kInlineShift | instruction_offset;
+  }
+
   void worker_thread(int pid);
-  bool lookup(stack_frame* stack_frame, IDebugSymbols5* debug_symbols);
-  std::vector<stack_frame> capture_stack_frames(int fill_frames,
-                                                IDebugControl7* debug_control,
-                                                IDebugSymbols5* debug_symbols);
+  void publish(uint32_t thread_id, const config& config);
+  static nlohmann::json serialize(const view& view);
+  void symbolizer_thread();
+  void stop_symbolizer();
+  void apply_symbols();
+  instruction_point* lookup(uint64_t instruction_offset);
+  const instruction_point* find(uint64_t instruction_offset) const;
+  static symbol to_symbol(const instruction_point& ip,
+                          std::span<const std::string_view> names);
+  void invalidate_symbols(const std::vector<mapped_range>& ranges);
+  void add_inline_frames(uint64_t instruction_offset,
+                         instruction_point* ip,
+                         const std::vector<inline_frame>& frames);
+  // |find| returns the instruction point of an offset or nullptr, so these
+  // work on the published view as well
+  template <typename F>
+  static void expand_inline_frames(std::span<const uint64_t> offsets,
+                                   F&& find,
+                                   std::vector<uint64_t>* frames);
+  template <typename F>
+  static rollup_keys make_rollup_keys(std::span<const uint64_t> frames,
+                                      F&& find,
+                                      generation_set* seen);
+  void add_heavy_hitters(uint32_t thread_id,
+                         std::span<const uint64_t> offsets);
+  void prune_instruction_points(
+      const std::unordered_map<uint32_t, std::vector<stack_frame>>&
+          last_stack_frames);
+  rollup_keys stack_rollup_keys(std::span<const uint64_t> stack);
+  static void add_rollups(const rollup_keys& keys,
+                          uint64_t count,
+                          flat_map<uint64_t, rollup>* functions,
+                          flat_map<uint64_t, rollup>* lines);
 
  private:
   Monitor monitor_;
+  std::unique_ptr<backend> backend_;
 
-  int process_id_;
-  int thread_id_;
+  int process_id_ = 0;
+  std::atomic<int> thread_id_ = 0;
 
   std::thread thread_;
   std::atomic<bool> exit_;
   std::atomic<state> state_ = state::preparing;
   std::string err_;
 
-  std::string process_name_;
   std::chrono::high_resolution_clock::time_point start_;
-  uint64_t counter_;
 
-  std::mutex mutex_serialize_;
+  std::mutex mutex_config_;
+  config config_;
+
+  // latest aggregates, published by the sampling thread for snapshot();
+  // buffers of views no reader holds anymore are refilled
+  std::atomic<std::shared_ptr<const view>> view_;
+  std::atomic<bool> view_requested_ = false;
+  uint64_t view_version_ = 0;
+  std::shared_ptr<view_pool> view_pool_ = std::make_shared<view_pool>();
+  // shared by the views published until symbols change again
+  std::shared_ptr<const symbol_table> symbol_table_;
+  bool symbols_changed_ = true;
+
+  // owned by the sampling thread, reset by start() while it is not running
+  std::string process_name_;
+  uint64_t counter_ = 0;
+  scheduler scheduler_;
+  scheduler::clock::time_point rate_start_;
+  uint64_t rate_counter_ = 0;
+  double sample_rate_ = 0;
+  uint64_t overruns_ = 0;
+  uint64_t idle_samples_ = 0;
+  uint64_t timestamp_ = 0;
   std::vector<thread> threads_;
   std::vector<stack_frame> stack_frame_;
-  std::map<uint32_t, std::map<uint64_t, uint64_t>> inclusive_;
-  std::map<uint32_t, std::map<uint64_t, uint64_t>> exclusive_;
-  std::map<uint64_t, std::unique_ptr<instruction_point>> instruction_point_map_;
+  // sample counts per thread and stack, expanded on snapshot
+  stack_table stacks_;
+  std::unordered_map<uint32_t, flat_map<uint32_t, uint64_t>> stack_counts_;
+  // per function and per source line counts, updated as samples arrive
+  std::vector<rollup_keys> rollup_keys_;  // by stack id
+  std::unordered_map<uint32_t, flat_map<uint64_t, rollup>> functions_;
+  std::unordered_map<uint32_t, flat_map<uint64_t, rollup>> lines_;
+  // recent samples, for snapshots of the last |config_.window| seconds
+  sliding_window window_;
+  // exponentially decayed counts, while |config_.half_life| is set
+  decayed_counts decay_;
+  // top addresses in bounded memory, replacing all of the above while
+  // |max_entries_| is set
+  size_t max_entries_ = 0;
+  size_t prune_at_ = 0;  // instruction points kept before pruning
+  std::unordered_map<uint32_t, heavy_hitters> inclusive_hitters_;
+  std::unordered_map<uint32_t, heavy_hitters> exclusive_hitters_;
+  generation_set seen_;  // frames of the stack being counted
+  std::vector<uint64_t> expanded_;  // stack with inlined calls expanded
+  // symbols by instruction offset
+  arena<instruction_point> instruction_points_;
+  std::shared_ptr<string_table> names_ = std::make_shared<string_table>();
+  flat_map<uint64_t, instruction_point*> instruction_point_map_;
+  // functions resolved so far, other addresses inside them only need their
+  // source line looked up
+  struct function_range {
+    uint32_t function_name;
+    uint64_t address;
+    uint64_t start;
+    uint32_t generation;
+  };
+  range_table<function_range> function_ranges_;
+  // stacks whose rollups wait for pending symbols
+  std::vector<uint32_t> pending_stacks_;
+  uint64_t pending_symbols_ = 0;
+
+  // symbolizer thread, resolving addresses off the sampling path
+  std::thread symbolizer_;
+  std::mutex mutex_symbols_;
+  std::condition_variable cv_symbols_;
+  bool symbolizer_exit_ = false;                // guarded by mutex_symbols_
+  std::vector<symbol_request> symbol_requests_;  // guarded by mutex_symbols_
+  std::vector<symbol_result> symbol_results_;    // guarded by mutex_symbols_
+  std::vector<mapped_range> mapped_ranges_;      // guarded by mutex_symbols_
 
   const int kMaxStackFrames = 256;
 };
@@ -118,9 +423,24 @@ class tracer {
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(tracer::thread,
                                    id,
                                    cycles,
-                                   instruction_offset);
+                                   instruction_offset,
+                                   idle);
+
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE_WITH_DEFAULT(tracer::config,
+                                                sample_frequency,
+                                                sample_jitter,
+                                                all_threads,
+                                                frame_budget,
+                                                unwind_workers,
+                                                skip_idle,
+                                                splice_stacks,
+                                                window,
+                                                window_retention,
+                                                half_life,
+                                                max_entries,
+                                                all_addresses);
 
-NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(tracer::instruction_point,
+NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(tracer::symbol,
                                    source_name,
                                    source_line,
                                    function_name,
@@ -163,9 +483,11 @@ class process {
   };
 
   static std::optional<process_snapshot> snapshot();
+#if defined(_WIN32)
   wil::unique_process_handle start(const std::string& cmdline,
                                    const std::string& cwd = {},
                                    uint32_t flags = 0);
+#endif
 };
 
 NLOHMANN_DEFINE_TYPE_NON_INTRUSIVE(process::thread_info,
@@ -10,6 +10,9 @@ function App() {
   const [stackframe, setStackframe] = useState([]);
   const [inclusive, setInclusive] = useState({});
   const [exclusive, setExclusive] = useState({});
+  const [errors, setErrors] = useState({} as any);
+  const [functions, setFunctions] = useState({});
+  const [lines, setLines] = useState([]);
 
   useEffect(() => {
     let id = setInterval(() => {
@@ -28,6 +31,11 @@ function App() {
           thread_id: json.thread_id,
           elapsed: json.elapsed,
           samples: json.samples,
+          sample_rate: json.sample_rate,
+          sample_frequency: json.config?.sample_frequency,
+          config: json.config,
+          error_bound: json.error_bound,
+          overruns: json.overruns,
           state: json.state,
         })
         setThreads(json.threads);
@@ -35,6 +43,13 @@ function App() {
         setStackframe(json.stack_frame);
         setInclusive(json.inclusive);
         setExclusive(json.exclusive);
+        setErrors({
+          inclusive: json.inclusive_error,
+          exclusive: json.exclusive_error,
+          bound: json.error_bound,
+        });
+        setFunctions(json.functions);
+        setLines(json.lines);
       }
     };
     uwu.watch(callback);
@@ -54,7 +69,7 @@ function App() {
       </div>
       <div id="bottom">
         <ThreadList threads={threads} threadId={summary.thread_id} instructionPointMap={instructionPointMap} />
-        <Stacktrace stackframe={stackframe} inclusive={inclusive} exclusive={exclusive} instructionPointMap={instructionPointMap} />
+        <Stacktrace stackframe={stackframe} inclusive={inclusive} exclusive={exclusive} errors={errors} functions={functions} lines={lines} config={summary.config} instructionPointMap={instructionPointMap} />
       </div>
     </div>
   );
@@ -14,30 +14,19 @@ export function Stacktrace(props) {
     return ip.source_name ? `${ip.source_name}:${ip.source_line}` : ""
   };
 
-  const inclusive = offset => props.inclusive[offset.toString()] || 0;
-  const exclusive = offset => props.exclusive[offset.toString()] || 0;
+  // bounded mode reports how much a tracked count may be too high
+  const with_error = (count, error) => error ? `${count} ±${error}` : `${count}`;
+  const inclusive_error = offset => props.errors?.inclusive?.[offset.toString()] || 0;
+  const exclusive_error = offset => props.errors?.exclusive?.[offset.toString()] || 0;
 
-  const inclusive_ranking = () =>
-    Object.keys(props.inclusive || []).map(_ => (
-      {
-        address: resolve_function(_),
-        count: props.inclusive[_]
-      }
-    ))
-    .sort((a, b) => b.count - a.count)
-    .slice(0, 20)
-    .map((_, _i, a) => ({
-      ..._,
-      percentage: (_.count / a[0].count * 100)
-    }))
+  const inclusive = offset => with_error(props.inclusive[offset.toString()] || 0, inclusive_error(offset));
+  const exclusive = offset => with_error(props.exclusive[offset.toString()] || 0, exclusive_error(offset));
 
-  const exclusive_ranking = () => 
-    Object.keys(props.exclusive || []).map(_ => (
-      {
-        address: resolve_function(_),
-        count: props.exclusive[_]
-      }
-    ))
+  // top 20 of |entries| by |count|, with a bar relative to the first
+  const ranking = (entries, count, error = _ => 0) =>
+    entries
+    .map(_ => ({ label: _.label, count: count(_), error: error(_) }))
+    .filter(_ => _.count > 0)
     .sort((a, b) => b.count - a.count)
     .slice(0, 20)
     .map((_, _i, a) => ({
@@ -45,6 +34,45 @@ export function Stacktrace(props) {
       percentage: (_.count / a[0].count * 100)
     }));
 
+  // rolled up by function; bounded mode has no rollups and ranks its
+  // tracked addresses instead
+  const function_entries = () => {
+    const functions = Object.values(props.functions || {}) as any[];
+    if (functions.length > 0) {
+      return functions.map(_ => ({ ..._, label: _.function_name || "(unknown)" }));
+    }
+    return Object.keys(props.inclusive || {}).map(_ => ({
+      label: resolve_function(_),
+      inclusive: props.inclusive[_],
+      exclusive: props.exclusive[_] || 0,
+      inclusive_error: inclusive_error(_),
+      exclusive_error: exclusive_error(_),
+    }));
+  };
+
+  const line_entries = () =>
+    (props.lines || []).map(_ => ({ ..._, label: `${_.source_name}:${_.source_line}` }));
+
+  // what the counts cover, after the ranking titles
+  const scope = kind => {
+    const config = props.config;
+    const bound = props.errors?.bound?.[kind];
+    if (bound !== undefined) {
+      return ` (UNTRACKED ≤${bound})`;
+    }
+    if (config?.half_life > 0) {
+      return ` (HALF-LIFE ${config.half_life} SEC)`;
+    }
+    if (config?.window > 0) {
+      return ` (LAST ${Math.min(config.window, config.window_retention)} SEC)`;
+    }
+    return "";
+  };
+
+  const inclusive_ranking = () => ranking(function_entries(), _ => _.inclusive, _ => _.inclusive_error || 0);
+  const exclusive_ranking = () => ranking(function_entries(), _ => _.exclusive, _ => _.exclusive_error || 0);
+  const line_ranking = () => ranking(line_entries(), _ => _.exclusive);
+
   return (
     <div id="stacktrace">
       <div className="table">
@@ -65,25 +93,34 @@ export function Stacktrace(props) {
       </div>
       <div className="ranking">
         <div className="inclusive">
-          <p className="desc">INCLUSIVE TOP 20</p>
+          <p className="desc">INCLUSIVE TOP 20{scope("inclusive")}</p>
           {
             inclusive_ranking().map((_, i) => (
               // @ts-ignore
-              <p key={i} style={{'--percentage': _.percentage + '%'}}>{_.address} ({_.count})</p>
+              <p key={i} style={{'--percentage': _.percentage + '%'}}>{_.label} ({with_error(_.count, _.error)})</p>
             ))
           }
         </div>
         <div className="exclusive">
-          <p className="desc">EXCLUSIVE TOP 20</p>
+          <p className="desc">EXCLUSIVE TOP 20{scope("exclusive")}</p>
           {
             exclusive_ranking().map((_, i) => (
               // @ts-ignore
-              <p key={i} style={{'--percentage': _.percentage + '%'}}>{_.address} ({_.count})</p>
+              <p key={i} style={{'--percentage': _.percentage + '%'}}>{_.label} ({with_error(_.count, _.error)})</p>
+            ))
+          }
+        </div>
+        <div className="lines">
+          <p className="desc">EXCLUSIVE LINES TOP 20{scope("exclusive")}</p>
+          {
+            line_ranking().map((_, i) => (
+              // @ts-ignore
+              <p key={i} style={{'--percentage': _.percentage + '%'}}>{_.label} ({with_error(_.count, _.error)})</p>
             ))
           }
-          </div>
         </div>
       </div>
+    </div>
   );
 }
 /*
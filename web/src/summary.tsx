@@ -1,8 +1,11 @@
-import { Clock3, Cpu, Layers, MemoryStick, PackagePlus, PackageSearch, Pause, RotateCcw } from 'lucide-react'
+import { Clock3, Cpu, Layers, MemoryStick, PackagePlus, PackageSearch, Pause, RotateCcw, SlidersHorizontal } from 'lucide-react'
 import { useEffect, useState } from 'react';
 
 export function Summary(props) {
   const [target, setTarget] = useState("livetrace.exe");
+  const [windowSeconds, setWindowSeconds] = useState("0");
+  const [halfLife, setHalfLife] = useState("0");
+  const [maxEntries, setMaxEntries] = useState("0");
 
   useEffect(() => {
     uwu.post({ type: "process", rule: target });
@@ -24,6 +27,60 @@ export function Summary(props) {
     uwu.post({ type: "pause" });
   };
 
+  // merged into the tracer's config, the next snapshot reports it back
+  const configure = config => {
+    uwu.post({ type: "config", config });
+  };
+
+  const changeWindow = value => {
+    setWindowSeconds(value);
+    const seconds = parseInt(value);
+    if (seconds >= 0) {
+      configure({ window: seconds });
+    }
+  };
+
+  const changeHalfLife = value => {
+    setHalfLife(value);
+    const seconds = parseFloat(value);
+    if (seconds >= 0) {
+      configure({ half_life: seconds });
+    }
+  };
+
+  // takes effect on the next attach, see restart
+  const changeMaxEntries = value => {
+    setMaxEntries(value);
+    const entries = parseInt(value);
+    if (entries >= 0) {
+      configure({ max_entries: entries });
+    }
+  };
+
+  // counts of tracked addresses are high by at most their error, untracked
+  // addresses occurred at most this often
+  const bounds = () => {
+    const bound = props.summary.error_bound;
+    if (!bound || bound.inclusive === undefined) return "";
+    return `, error up to ${bound.inclusive} inclusive / ${bound.exclusive} exclusive`;
+  };
+
+  const counting = () => {
+    const config = props.summary.config;
+    if (!config) return "(unknown)";
+    const bounded = props.summary.error_bound?.inclusive !== undefined;
+    if (bounded) {
+      return `top addresses per thread${bounds()}`;
+    }
+    if (config.half_life > 0) {
+      return `decayed, half-life ${config.half_life} sec`;
+    }
+    if (config.window > 0) {
+      return `last ${Math.min(config.window, config.window_retention)} sec (${config.window_retention} sec kept)`;
+    }
+    return "all samples";
+  };
+
   return (
     <div className="summary">
       <div className="header process-start">
@@ -55,7 +112,7 @@ export function Summary(props) {
       <div className="header stacktrace">
         <Layers size={48} strokeWidth={0.5} />
         <p className="desc">STACKTRACES</p>
-        <p className="value">{new Intl.NumberFormat('en-US').format(props.summary.samples)} ({(props.summary.samples / (props.summary.elapsed / 1000)).toFixed(2)}/sec)</p>
+        <p className="value">{new Intl.NumberFormat('en-US').format(props.summary.samples)} ({props.summary.sample_rate?.toFixed(2)}/{props.summary.sample_frequency}/sec, {new Intl.NumberFormat('en-US').format(props.summary.overruns)} overruns)</p>
       </div>
       <div className="header cpu">
         <Cpu size={48} strokeWidth={0.5} />
@@ -72,6 +129,19 @@ export function Summary(props) {
         <p className="desc">VIRT MEM USAGE</p>
         <p className="value">{new Intl.NumberFormat('en-US').format(props.summary.process_virt_mem_usage)}</p>
       </div>
+      <div className="header counting">
+        <SlidersHorizontal size={48} strokeWidth={0.5} />
+        <p className="desc">COUNTING</p>
+        <p className="stack">
+          <span className="value">{counting()}</span>
+          <label>WINDOW (SEC, 0 FOR ALL)</label>
+          <input type="number" min={0} value={windowSeconds} onChange={e => changeWindow(e.target.value)}></input>
+          <label>HALF-LIFE (SEC, 0 FOR NONE)</label>
+          <input type="number" min={0} step={0.5} value={halfLife} onChange={e => changeHalfLife(e.target.value)}></input>
+          <label>MAX ENTRIES (0 FOR ALL, ON RESTART)</label>
+          <input type="number" min={0} value={maxEntries} onChange={e => changeMaxEntries(e.target.value)}></input>
+        </p>
+      </div>
     </div>
   )
 }
@@ -22,8 +22,8 @@ export function ThreadList(props) {
           props.threads.map((_, i) => (
             <Fragment key={i}>
               <p onMouseDown={() => select(_.id)} className={props.threadId === _.id ? "active" : ""}>{_.id}</p>
-              <p onMouseDown={() => select(_.id)}>{resolve(_.instruction_offset ?? -1)}</p>
-              <p onMouseDown={() => select(_.id)}>{new Intl.NumberFormat('en-US').format(_.cycles)}</p>
+              <p onMouseDown={() => select(_.id)} className={_.idle ? "idle" : ""}>{resolve(_.instruction_offset ?? -1)}</p>
+              <p onMouseDown={() => select(_.id)} className={_.idle ? "idle" : ""}>{new Intl.NumberFormat('en-US').format(_.cycles)}</p>
             </Fragment>
           ))
         }
@@ -0,0 +1,59 @@
+#include "worker_pool.h"
+
+#include <algorithm>
+
+worker_pool::worker_pool(int size) {
+  for (int i = 1; i < std::max(size, 1); ++i) {
+    threads_.emplace_back(&worker_pool::worker_thread, this, i);
+  }
+}
+
+worker_pool::~worker_pool() {
+  {
+    std::lock_guard lock(mutex_);
+    exit_ = true;
+  }
+  cv_task_.notify_all();
+  for (auto& thread : threads_) {
+    thread.join();
+  }
+}
+
+void worker_pool::run(const std::function<void(int worker)>& task) {
+  {
+    std::lock_guard lock(mutex_);
+    task_ = &task;
+    pending_ = (int)threads_.size();
+    generation_++;
+  }
+  cv_task_.notify_all();
+
+  task(0);
+
+  std::unique_lock lock(mutex_);
+  cv_done_.wait(lock, [&] { return pending_ == 0; });
+  task_ = nullptr;
+}
+
+void worker_pool::worker_thread(int worker) {
+  uint64_t generation = 0;
+  while (true) {
+    const std::function<void(int)>* task;
+    {
+      std::unique_lock lock(mutex_);
+      cv_task_.wait(lock, [&] { return exit_ || generation_ != generation; });
+      if (exit_) {
+        return;
+      }
+      generation = generation_;
+      task = task_;
+    }
+
+    (*task)(worker);
+
+    std::lock_guard lock(mutex_);
+    if (--pending_ == 0) {
+      cv_done_.notify_one();
+    }
+  }
+}
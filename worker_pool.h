@@ -0,0 +1,37 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Fixed set of threads that all run the same task. A worker index always
+// maps to the same thread, so work that is bound to the thread it was started
+// on (e.g. ptrace requests) can be partitioned by worker.
+class worker_pool {
+ public:
+  // |size| includes the calling thread, which runs as worker 0.
+  explicit worker_pool(int size);
+  ~worker_pool();
+
+  worker_pool(const worker_pool&) = delete;
+  worker_pool& operator=(const worker_pool&) = delete;
+
+  int size() const { return (int)threads_.size() + 1; }
+
+  // Runs |task| on every worker and waits until all of them return.
+  void run(const std::function<void(int worker)>& task);
+
+ private:
+  void worker_thread(int worker);
+
+  std::vector<std::thread> threads_;
+  std::mutex mutex_;
+  std::condition_variable cv_task_;
+  std::condition_variable cv_done_;
+  const std::function<void(int)>* task_ = nullptr;
+  uint64_t generation_ = 0;
+  int pending_ = 0;
+  bool exit_ = false;
+};